@@ -38,9 +38,23 @@ static void array__move(array this, size_t dst_index, size_t src_index, size_t c
  * deletion.
  */
 
-array array_alloc(size_t capacity, size_t mem_size)
+/*
+ * The bytes needed for an array of capacity members of mem_size bytes
+ * each.
+ */
+size_t array_bytes(size_t capacity, size_t mem_size)
+{
+  return sizeof(struct array) + capacity * mem_size;
+}
+
+/*
+ * Set up an empty array in the array_bytes() bytes at mem, which must
+ * be aligned for a size_t.  The caller owns the memory: an array set
+ * up this way is not to be passed to array_free().
+ */
+array array_init(void *mem, size_t capacity, size_t mem_size)
 {
-  array this = calloc(1, sizeof(struct array) + capacity * mem_size);
+  array this = mem;
   this->capacity = capacity;
   this->mem_size = mem_size;
   this->gap = 0;
@@ -48,6 +62,11 @@ array array_alloc(size_t capacity, size_t mem_size)
   return this;
 }
 
+array array_alloc(size_t capacity, size_t mem_size)
+{
+  return array_init(calloc(1, array_bytes(capacity, mem_size)), capacity, mem_size);
+}
+
 array array_free(array this)
 {
   free(this);
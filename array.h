@@ -8,6 +8,8 @@ typedef struct array {
   char   data[];   /* member data */
 } *array;
 
+size_t array_bytes(size_t capacity, size_t mem_size);
+array array_init(void *mem, size_t capacity, size_t mem_size);
 array array_alloc(size_t capacity, size_t mem_size);
 array array_free(array this);
 
@@ -23,3 +25,78 @@ void array_top(array this, void *member);
 size_t array_length(array this);
 size_t array_capacity(array this);
 
+
+/*
+ * Typed Arrays
+ * ------------
+ *
+ * ARRAY_DEFINE(name, type) defines name, a fixed capacity stack of
+ * type, with inline functions name_push() etc.  Members are copied
+ * by assignment, the size known at compile time, instead of with a
+ * memmove() of mem_size bytes through the gap buffer above.
+ *
+ * name_emplace() returns the slot for a new member to be built in
+ * place, and name_pop() the slot of the member it removed, valid
+ * until the next push, so neither needs to copy at all.  Memory is
+ * the caller's, name_bytes(capacity) of it, as with array_init().
+ */
+
+#include <assert.h>
+
+#define ARRAY_DEFINE(name, type)                                        \
+  typedef struct {                                                      \
+    size_t capacity;                                                    \
+    size_t length;                                                      \
+    type   data[];                                                      \
+  } name;                                                               \
+                                                                        \
+  static inline size_t name##_bytes(size_t capacity)                    \
+  {                                                                     \
+    return sizeof(name) + capacity * sizeof(type);                      \
+  }                                                                     \
+                                                                        \
+  static inline name *name##_init(void *mem, size_t capacity)           \
+  {                                                                     \
+    name *this = mem;                                                   \
+    this->capacity = capacity;                                          \
+    this->length = 0;                                                   \
+    return this;                                                        \
+  }                                                                     \
+                                                                        \
+  static inline type *name##_emplace(name *this)                        \
+  {                                                                     \
+    assert(this->length < this->capacity);                              \
+    return &this->data[this->length++];                                 \
+  }                                                                     \
+                                                                        \
+  static inline void name##_push(name *this, type const *member)        \
+  {                                                                     \
+    *name##_emplace(this) = *member;                                    \
+  }                                                                     \
+                                                                        \
+  static inline type *name##_pop(name *this)                            \
+  {                                                                     \
+    assert(this->length > 0);                                           \
+    return &this->data[--this->length];                                 \
+  }                                                                     \
+                                                                        \
+  static inline type *name##_at(name *this, size_t index)               \
+  {                                                                     \
+    assert(index < this->length);                                       \
+    return &this->data[index];                                          \
+  }                                                                     \
+                                                                        \
+  static inline void name##_clear(name *this)                           \
+  {                                                                     \
+    this->length = 0;                                                   \
+  }                                                                     \
+                                                                        \
+  static inline size_t name##_length(name const *this)                  \
+  {                                                                     \
+    return this->length;                                                \
+  }                                                                     \
+                                                                        \
+  static inline size_t name##_capacity(name const *this)                \
+  {                                                                     \
+    return this->capacity;                                              \
+  }
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <string.h>
+#include <time.h>
 
 #include "array.h"
 
@@ -9,6 +11,8 @@ typedef struct {
   int x, y;
 } point;
 
+ARRAY_DEFINE(point_stack, point)
+
 
 point make_point(int x, int y)
 {
@@ -64,6 +68,141 @@ void test_buffer(void)
   assert(!b);
 }
 
+void test_init(void)
+{
+  point p;
+  size_t mem[(sizeof(struct array) + 3 * sizeof(point)) / sizeof(size_t) + 1];
+  assert(array_bytes(3, sizeof(point)) <= sizeof(mem));
+  array b = array_init(mem, 3, sizeof(point));
+
+  assert(array_length(b) == 0);
+  assert(array_capacity(b) == 3);
+  p = make_point(1, 2);
+  array_push(b, &p);
+  p = make_point(3, 4);
+  array_ins(b, 0, &p);
+  array_get(b, 1, &p);
+  assert(p.x == 1 && p.y == 2);
+  array_pop(b, &p);
+  assert(p.x == 1 && p.y == 2);
+  array_pop(b, &p);
+  assert(p.x == 3 && p.y == 4);
+  assert(array_length(b) == 0);
+}
+
+void test_stack(void)
+{
+  size_t mem[(sizeof(point_stack) + 3 * sizeof(point)) / sizeof(size_t) + 1];
+  assert(point_stack_bytes(3) <= sizeof(mem));
+  point_stack *b = point_stack_init(mem, 3);
+
+  assert(point_stack_length(b) == 0);
+  assert(point_stack_capacity(b) == 3);
+  point p = make_point(0, 1);
+  point_stack_push(b, &p);
+  *point_stack_emplace(b) = make_point(2, 3);
+  p = make_point(4, 5);
+  point_stack_push(b, &p);
+  assert(point_stack_length(b) == 3);
+  assert(point_stack_at(b, 1)->x == 2);
+
+  point *q = point_stack_pop(b);
+  assert(q->x == 4 && q->y == 5);
+  q = point_stack_pop(b);
+  assert(q->x == 2 && q->y == 3);
+  assert(point_stack_length(b) == 1);
+  point_stack_clear(b);
+  assert(point_stack_length(b) == 0);
+}
+
+/*
+ * Microbenchmarks
+ * ---------------
+ *
+ * ./array_test -b times pushing and popping sudoku sized members (81
+ * shorts) as the solver does, through the gap buffer and through a
+ * typed stack, copying in and out and building in place.
+ */
+
+typedef struct {
+  unsigned short free[81];
+} board;
+
+ARRAY_DEFINE(board_stack, board)
+
+#define BENCH_ROUNDS 2000000
+#define BENCH_DEPTH  4
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void report(char const *name, double start, unsigned long sum)
+{
+  double ns = (now() - start) * 1e9 / (2.0 * BENCH_ROUNDS * BENCH_DEPTH);
+  printf("%-16s %6.2f ns/op  (%lu)\n", name, ns, sum);
+}
+
+static void bench(void)
+{
+  board m;
+  unsigned long sum = 0;
+  memset(&m, 0, sizeof(m));
+
+  array a = array_alloc(BENCH_DEPTH, sizeof(board));
+  double start = now();
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    for (int i = 0; i < BENCH_DEPTH; i++) {
+      m.free[i] = r + i;
+      array_push(a, &m);
+    }
+    for (int i = 0; i < BENCH_DEPTH; i++) {
+      array_pop(a, &m);
+      sum += m.free[BENCH_DEPTH - 1 - i];
+    }
+  }
+  report("array", start, sum);
+  array_free(a);
+
+  board_stack *b = board_stack_init(malloc(board_stack_bytes(BENCH_DEPTH)), BENCH_DEPTH);
+  sum = 0;
+  start = now();
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    for (int i = 0; i < BENCH_DEPTH; i++) {
+      m.free[i] = r + i;
+      board_stack_push(b, &m);
+    }
+    for (int i = 0; i < BENCH_DEPTH; i++) {
+      m = *board_stack_pop(b);
+      sum += m.free[BENCH_DEPTH - 1 - i];
+    }
+  }
+  report("stack copy", start, sum);
+
+  sum = 0;
+  start = now();
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    for (int i = 0; i < BENCH_DEPTH; i++) {
+      board *e = board_stack_emplace(b);
+      *e = m;
+      e->free[i] = r + i;
+    }
+    for (int i = 0; i < BENCH_DEPTH; i++)
+      sum += board_stack_pop(b)->free[BENCH_DEPTH - 1 - i];
+  }
+  report("stack in place", start, sum);
+  free(b);
+}
+
 int main(int n, char **args) {
+  if (n > 1 && strcmp(args[1], "-b") == 0) {
+    bench();
+    return 0;
+  }
   test_buffer();
+  test_init();
+  test_stack();
 }
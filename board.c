@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "board.h"
+
+/*
+ * Larger Boards
+ * =============
+ *
+ * The solver in solver.c is written for 9x9 boards only: a digit set
+ * is a short counted with a lookup table, and the neighbors and units
+ * are tables pasted into the source.  A board with boxes of BOX x BOX
+ * positions has SIDE = BOX * BOX digits and SIDE * SIDE positions.
+ * This file solves such boards, and is compiled once per size with
+ * -DSIDE=16 or -DSIDE=25 into functions whose names carry the size,
+ * solve_board16() and solve_board25().  Every size is a constant in
+ * its own copy, so each gets its own digit set width and table sizes
+ * and loops the compiler can unroll, while 9x9 boards keep their
+ * tuned solver.
+ *
+ * The search is that of the reference engine (see solve()): copy the
+ * board before each choice, revoke naked singles through a queue,
+ * look for hidden singles at level 1 and locked candidates at level
+ * 2, and branch on the first position with the fewest digits left,
+ * trying its digits in order.  (Compiled with -DSIDE=9, it reports
+ * the same choices and backtracks as the reference engine.)
+ */
+
+#if SIDE == 9
+#define BOX 3
+typedef uint16_t digit_set;
+#elif SIDE == 16
+#define BOX 4
+typedef uint16_t digit_set;
+#elif SIDE == 25
+#define BOX 5
+typedef uint32_t digit_set;
+#else
+#error "SIDE must be 9, 16 or 25"
+#endif
+
+#define CAT(a, b)  a##b
+#define XCAT(a, b) CAT(a, b)
+#define SIZED(name) XCAT(name, SIDE)
+
+/*
+ * Digit Sets
+ * ----------
+ *
+ * Digit k (0 .. SIDE-1) is bit k, so 16 digits still fit a short.  A
+ * lookup table for 16 or 25 bits would be too large to stay in cache,
+ * so sets are counted with the popcount instruction.
+ */
+
+#define NO_DIGITS     ((digit_set)0)
+#define ALL_DIGITS    ((digit_set)((1u << SIDE) - 1))
+#define SET_OF(k)     ((digit_set)(1u << (k)))
+#define IN_SET(set, k) (((set) & SET_OF(k)) != 0)
+#define SET_SIZE(set) __builtin_popcount(set)
+
+/*
+ * Neighbors and Units
+ * -------------------
+ *
+ * Rows are units 0 .. SIDE-1, columns SIDE .. 2*SIDE-1 and boxes the
+ * rest, as for 9x9.  The tables are made once, on first use, from the
+ * same definitions.
+ */
+
+#define CELLS         (SIDE * SIDE)
+#define NUM_UNITS     (3 * SIDE)
+#define NUM_NEIGHBORS (2 * (SIDE - 1) + (BOX - 1) * (BOX - 1))
+
+typedef uint16_t pos;
+
+#define ROW_OF(p)     ((p) / SIDE)
+#define COL_OF(p)     ((p) % SIDE)
+#define BOX_OF(p)     ((p) / (SIDE * BOX) * BOX + (p) % SIDE / BOX)
+#define BOX_UNIT(b)   (2 * SIDE + (b))
+
+static pos neighbors[CELLS][NUM_NEIGHBORS];
+static pos units[NUM_UNITS][SIDE];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void make_tables(void)
+{
+  int size[NUM_UNITS] = { 0 };
+  for (int p = 0; p < CELLS; p++) {
+    int n = 0;
+    for (int q = 0; q < CELLS; q++)
+      if (q != p && (ROW_OF(q) == ROW_OF(p) || COL_OF(q) == COL_OF(p) ||
+                     BOX_OF(q) == BOX_OF(p)))
+        neighbors[p][n++] = q;
+    units[ROW_OF(p)][size[ROW_OF(p)]++] = p;
+    units[SIDE + COL_OF(p)][size[SIDE + COL_OF(p)]++] = p;
+    units[BOX_UNIT(BOX_OF(p))][size[BOX_UNIT(BOX_OF(p))]++] = p;
+  }
+}
+
+typedef struct {
+  digit_set free[CELLS];
+} board;
+
+/*
+ * Propagation
+ * -----------
+ *
+ * As in solver.c, without a trail.
+ */
+
+typedef struct {
+  pos       pos[CELLS];
+  digit_set ds[CELLS];
+  int       head, tail;
+} revoke_queue;
+
+static inline bool revoke_from(board *b, revoke_queue *q, pos p, digit_set ds)
+{
+  digit_set f = b->free[p];
+  if (!(f & ds))
+    return true;
+  b->free[p] = f &= ~ds;
+  if (f == NO_DIGITS)
+    return false;
+  if (SET_SIZE(f) == 1) {
+    q->pos[q->tail] = p;
+    q->ds[q->tail++] = f;
+  }
+  return true;
+}
+
+static bool revoke_drain(board *b, revoke_queue *q)
+{
+  while (q->head < q->tail) {
+    pos p = q->pos[q->head];
+    digit_set ds = q->ds[q->head++];
+    for (int i = 0; i < NUM_NEIGHBORS; i++)
+      if (!revoke_from(b, q, neighbors[p][i], ds))
+        return false;
+  }
+  return true;
+}
+
+/* Leave ds alone at p, and revoke it from the neighbors. */
+static bool fix(board *b, pos p, digit_set ds)
+{
+  revoke_queue q;
+  b->free[p] = ds;
+  q.head = q.tail = 0;
+  q.pos[q.tail] = p;
+  q.ds[q.tail++] = ds;
+  return revoke_drain(b, &q);
+}
+
+static bool eliminate(board *b, pos p, digit_set ds)
+{
+  revoke_queue q;
+  q.head = q.tail = 0;
+  return revoke_from(b, &q, p, ds) && revoke_drain(b, &q);
+}
+
+static bool hidden_singles(board *b, bool *changed)
+{
+  for (int u = 0; u < NUM_UNITS; u++) {
+    digit_set once = NO_DIGITS, twice = NO_DIGITS;
+    for (int i = 0; i < SIDE; i++) {
+      digit_set f = b->free[units[u][i]];
+      twice |= once & f;
+      once |= f;
+    }
+    if (once != ALL_DIGITS)
+      return false;
+
+    digit_set hidden = once & ~twice;
+    if (hidden == NO_DIGITS)
+      continue;
+    for (int i = 0; i < SIDE; i++) {
+      pos p = units[u][i];
+      digit_set h = b->free[p] & hidden;
+      if (h == NO_DIGITS)
+        continue;
+      if (SET_SIZE(h) > 1)
+        return false;
+      if (h != b->free[p]) {
+        if (!fix(b, p, h))
+          return false;
+        *changed = true;
+      }
+    }
+  }
+  return true;
+}
+
+static inline bool on_line(pos p, int line)
+{
+  return line < SIDE ? ROW_OF(p) == line : COL_OF(p) == line - SIDE;
+}
+
+static bool locked_candidates(board *b, bool *changed)
+{
+  for (int x = 0; x < SIDE; x++) {
+    pos const *box = units[BOX_UNIT(x)];
+    for (int k = 0; k < 2 * BOX; k++) {
+      int line = (k < BOX) ? x / BOX * BOX + k : SIDE + x % BOX * BOX + k - BOX;
+      pos const *cells = units[line];
+      digit_set cross = NO_DIGITS, box_rest = NO_DIGITS, line_rest = NO_DIGITS;
+      for (int i = 0; i < SIDE; i++) {
+        if (on_line(box[i], line))
+          cross |= b->free[box[i]];
+        else
+          box_rest |= b->free[box[i]];
+        if (BOX_OF(cells[i]) != x)
+          line_rest |= b->free[cells[i]];
+      }
+      digit_set pointing = cross & ~box_rest & line_rest;
+      digit_set claiming = cross & ~line_rest & box_rest;
+      for (int i = 0; i < SIDE; i++) {
+        pos p = cells[i];
+        if (BOX_OF(p) != x && (b->free[p] & pointing)) {
+          if (!eliminate(b, p, pointing))
+            return false;
+          *changed = true;
+        }
+        p = box[i];
+        if (!on_line(p, line) && (b->free[p] & claiming)) {
+          if (!eliminate(b, p, claiming))
+            return false;
+          *changed = true;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static bool propagate(board *b, int level)
+{
+  bool changed;
+  if (level == 0)
+    return true;
+  do {
+    changed = false;
+    if (!hidden_singles(b, &changed))
+      return false;
+    if (!changed && level >= 2 && !locked_candidates(b, &changed))
+      return false;
+  } while (changed);
+  return true;
+}
+
+/*
+ * Search
+ * ------
+ */
+
+static inline char digit_char(int k)
+{
+  return (k < 9) ? '1' + k : 'A' + k - 9;
+}
+
+static inline int char_digit(char c)
+{
+  int k = -1;
+  if ('1' <= c && c <= '9')
+    k = c - '1';
+  else if ('A' <= c && c <= 'Z')
+    k = c - 'A' + 9;
+  else if ('a' <= c && c <= 'z')
+    k = c - 'a' + 9;
+  return (k < SIDE) ? k : -1;
+}
+
+static pos next_move(board const *b)
+{
+  int p = 0, m = SIDE + 1;
+  for (int i = 0; i < CELLS; i++) {
+    int n = SET_SIZE(b->free[i]);
+    if (n == 0)
+      return i;
+    if (n > 1 && n < m) {
+      m = n;
+      p = i;
+    }
+  }
+  return p;
+}
+
+static bool search(board_job *j, board *b)
+{
+  j->choice++;
+  if (!propagate(b, j->level))
+    return false;
+
+  pos p = next_move(b);
+  digit_set dsp = b->free[p];
+  int n = SET_SIZE(dsp);
+  if (n == 0)
+    return false;
+
+  if (n == 1) {
+    if (j->kept < j->max_sols) {
+      char *t = j->solutions + j->kept++ * CELLS;
+      for (int i = 0; i < CELLS; i++)
+        t[i] = digit_char(__builtin_ctz(b->free[i]));
+    }
+    return ++j->found == j->limit;
+  }
+
+  board r = *b;
+  for (int k = 0; k < SIDE; k++) {
+    if (IN_SET(dsp, k)) {
+      if (fix(b, p, SET_OF(k)) && search(j, b))
+        return true;
+      j->backtrack++;
+      *b = r;
+    }
+  }
+  return false;
+}
+
+void SIZED(solve_board)(board_job *j)
+{
+  pthread_once(&tables_once, make_tables);
+  j->kept = 0;
+  j->found = 0;
+  j->choice = 0;
+  j->backtrack = 0;
+
+  board b;
+  for (int i = 0; i < CELLS; i++)
+    b.free[i] = ALL_DIGITS;
+  for (int i = 0; i < CELLS && i < j->len; i++) {
+    int k = char_digit(j->text[i]);
+    if (k < 0)
+      continue;
+    if (!IN_SET(b.free[i], k) || !fix(&b, i, SET_OF(k))) {
+      /* the givens contradict each other */
+      b.free[i] = NO_DIGITS;
+      break;
+    }
+  }
+  search(j, &b);
+}
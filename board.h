@@ -0,0 +1,24 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+/*
+ * Boards of other sizes, see board.c.  A puzzle of side S (16 or 25)
+ * is S * S characters: for digits '1'-'9' and then letters from 'A'
+ * (either case), anything else for open cells.
+ */
+
+typedef struct {
+  char const *text;   /* the puzzle, len characters; the rest open */
+  size_t      len;
+  int         level;  /* propagation, as for 9x9 boards */
+  long        limit;  /* stop after this many solutions */
+  size_t      max_sols;
+  char       *solutions; /* room for max_sols solutions of S * S */
+  size_t      kept;   /* solutions written to solutions */
+  long        found;  /* solutions found, kept or not */
+  int         choice;
+  int         backtrack;
+} board_job;
+
+void solve_board16(board_job *j);
+void solve_board25(board_job *j);
@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "packed.h"
+
+/*
+ * Convert
+ * =======
+ *
+ * Translates puzzle and result files between the text format read
+ * and written by sudoku and the packed format (see packed.c).
+ *
+ *   ./convert < puzzles/x00 > x00.sdk
+ *   ./convert < x00.sdk
+ *
+ * Packed input is converted to text and text input to packed.  Text
+ * input whose first line is longer than a puzzle is taken to be
+ * results, anything else puzzles.
+ */
+
+#define PUZZLE_SIZE PACKED_CELLS
+
+static char const *prog;
+static size_t line_no;
+
+static void fail(char const *msg)
+{
+  fprintf(stderr, "%s: line %zu: %s\n", prog, line_no, msg);
+  exit(1);
+}
+
+static void put(void const *b, size_t n)
+{
+  if (fwrite(b, 1, n, stdout) != n) {
+    perror(prog);
+    exit(1);
+  }
+}
+
+/*
+ * Text to Packed
+ * --------------
+ */
+
+static ssize_t next_line(char **buf, size_t *len, FILE *in)
+{
+  ssize_t n = getline(buf, len, in);
+  if (n < 0)
+    return n;
+  line_no++;
+  if (n > 0 && (*buf)[n - 1] == '\n')
+    n--;
+  if (n > 0 && (*buf)[n - 1] == '\r')
+    n--;
+  (*buf)[n] = '\0';
+  return n;
+}
+
+/* Normalize the puzzle text of len characters to 81, '.' if open. */
+static void normalize(char *puzzle, char const *text, size_t len)
+{
+  memset(puzzle, '.', PUZZLE_SIZE);
+  for (size_t i = 0; i < len && i < PUZZLE_SIZE; i++)
+    if ('1' <= text[i] && text[i] <= '9')
+      puzzle[i] = text[i];
+}
+
+static void pack_puzzles(char *line, ssize_t n, FILE *in, size_t *len)
+{
+  unsigned char b[PACKED_PUZZLE_MAX];
+  put(packed_puzzle_magic, PACKED_MAGIC_SIZE);
+  for (; n >= 0; n = next_line(&line, len, in)) {
+    char puzzle[PUZZLE_SIZE];
+    normalize(puzzle, line, n);
+    put(b, pack_puzzle(b, puzzle, PUZZLE_SIZE));
+  }
+  free(line);
+}
+
+typedef struct {
+  char puzzle[PUZZLE_SIZE];
+  unsigned long choice, backtrack;
+  int index, count;
+  char solution[PUZZLE_SIZE + 1];
+} result;
+
+/*
+ * Parse a result line as printed by sudoku: the puzzle right aligned
+ * in 81 characters, the counts, and the solution if there is one.
+ */
+static void parse_result(result *r, char const *line, size_t n)
+{
+  if (n < PUZZLE_SIZE)
+    fail("not a result");
+  size_t start = 0;
+  while (start < PUZZLE_SIZE && line[start] == ' ')
+    start++;
+  normalize(r->puzzle, line + start, PUZZLE_SIZE - start);
+  r->solution[0] = '\0';
+  int fields = sscanf(line + PUZZLE_SIZE, "%lu %lu %d %d %81s",
+                      &r->choice, &r->backtrack, &r->index, &r->count,
+                      r->solution);
+  if (fields < 4 || (r->count > 0) != (fields == 5) ||
+      (r->count > 0 && strlen(r->solution) != PUZZLE_SIZE))
+    fail("not a result");
+}
+
+static void pack_results(char *line, ssize_t n, FILE *in, size_t *len)
+{
+  unsigned char b[PACKED_PUZZLE_MAX + 3 * PACKED_UINT_MAX];
+  put(packed_result_magic, PACKED_MAGIC_SIZE);
+  for (; n >= 0; n = next_line(&line, len, in)) {
+    result r, s;
+    parse_result(&r, line, n);
+    if (r.index != (r.count > 0))
+      fail("result out of order");
+    size_t k = pack_puzzle(b, r.puzzle, PUZZLE_SIZE);
+    k += pack_uint(b + k, r.choice);
+    k += pack_uint(b + k, r.backtrack);
+    k += pack_uint(b + k, r.count);
+    put(b, k);
+    /* the remaining solutions follow on lines of their own */
+    for (int i = 1; i <= r.count; i++) {
+      if (i > 1) {
+        if ((n = next_line(&line, len, in)) < 0)
+          fail("missing solutions");
+        parse_result(&s, line, n);
+        if (memcmp(s.puzzle, r.puzzle, PUZZLE_SIZE) != 0 ||
+            s.index != i || s.count != r.count)
+          fail("result out of order");
+        memcpy(r.solution, s.solution, PUZZLE_SIZE);
+      }
+      put(b, pack_solution(b, r.puzzle, r.solution));
+    }
+  }
+  free(line);
+}
+
+/*
+ * Packed to Text
+ * --------------
+ */
+
+static bool read_puzzle(char *puzzle, FILE *in)
+{
+  unsigned char b[PACKED_PUZZLE_MAX];
+  size_t n = fread(b, 1, PACKED_BITMAP_SIZE, in);
+  if (n == 0)
+    return false;
+  line_no++;
+  if (n == PACKED_BITMAP_SIZE) {
+    size_t size = packed_puzzle_size(b);
+    n += fread(b + n, 1, size - n, in);
+  }
+  if (!unpack_puzzle(puzzle, b, n))
+    fail("truncated puzzle");
+  return true;
+}
+
+static unsigned long read_uint(FILE *in)
+{
+  unsigned char b[PACKED_UINT_MAX];
+  unsigned long v;
+  size_t n = 0;
+  int c;
+  do {
+    if ((c = getc(in)) == EOF)
+      fail("truncated result");
+    b[n++] = c;
+  } while ((c & 0x80) && n < PACKED_UINT_MAX);
+  if (!unpack_uint(&v, b, n))
+    fail("bad count");
+  return v;
+}
+
+static void unpack_puzzles(FILE *in)
+{
+  char puzzle[PUZZLE_SIZE];
+  while (read_puzzle(puzzle, in))
+    printf("%.*s\n", PUZZLE_SIZE, puzzle);
+}
+
+static void unpack_results(FILE *in)
+{
+  char puzzle[PUZZLE_SIZE];
+  while (read_puzzle(puzzle, in)) {
+    unsigned long choice = read_uint(in);
+    unsigned long backtrack = read_uint(in);
+    unsigned long count = read_uint(in);
+    if (count == 0)
+      printf("%.*s %8lu %8lu 0 0\n", PUZZLE_SIZE, puzzle, choice, backtrack);
+    for (unsigned long i = 1; i <= count; i++) {
+      unsigned char b[PACKED_DIGITS_SIZE];
+      char solution[PUZZLE_SIZE];
+      size_t size = packed_solution_size(puzzle);
+      if (fread(b, 1, size, in) != size)
+        fail("truncated solution");
+      unpack_solution(solution, puzzle, b, size);
+      printf("%.*s %8lu %8lu %1lu %1lu %.*s\n", PUZZLE_SIZE, puzzle,
+             choice, backtrack, i, count, PUZZLE_SIZE, solution);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  prog = argv[0];
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [file]\n", prog);
+    return 2;
+  }
+  FILE *in = (argc == 2) ? fopen(argv[1], "r") : stdin;
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  unsigned char magic[PACKED_MAGIC_SIZE];
+  int c = getc(in);
+  if (c == packed_puzzle_magic[0]) {
+    magic[0] = c;
+    if (fread(magic + 1, 1, PACKED_MAGIC_SIZE - 1, in) != PACKED_MAGIC_SIZE - 1)
+      fail("truncated header");
+    if (memcmp(magic, packed_puzzle_magic, PACKED_MAGIC_SIZE) == 0)
+      unpack_puzzles(in);
+    else if (memcmp(magic, packed_result_magic, PACKED_MAGIC_SIZE) == 0)
+      unpack_results(in);
+    else
+      fail("unknown packed format");
+  } else if (c != EOF) {
+    ungetc(c, in);
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n = next_line(&line, &len, in);
+    if (n > PUZZLE_SIZE)
+      pack_results(line, n, in, &len);
+    else
+      pack_puzzles(line, n, in, &len);
+  }
+
+  fclose(in);
+  if (fflush(stdout) != 0) {
+    perror(prog);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#include "counters.h"
+
+/*
+ * Hardware Counters
+ * =================
+ *
+ * A group of three counters of the thread that opens them, counting
+ * in user space only, all read with a single read().
+ *
+ * perf_event_open() is often not allowed (see perf_event_paranoid in
+ * /proc/sys/kernel) or not supported, in containers and virtual
+ * machines in particular.  counters_open() then returns false.
+ */
+
+#define NUM_COUNTERS 3
+
+static int group = -1;
+
+static int open_counter(uint32_t type, uint64_t config, int group_fd)
+{
+  struct perf_event_attr a;
+  memset(&a, 0, sizeof(a));
+  a.size = sizeof(a);
+  a.type = type;
+  a.config = config;
+  a.disabled = (group_fd == -1);
+  a.exclude_kernel = 1;
+  a.exclude_hv = 1;
+  a.read_format = PERF_FORMAT_GROUP;
+  return syscall(SYS_perf_event_open, &a, 0, -1, group_fd, 0);
+}
+
+bool counters_open(void)
+{
+  int fd[NUM_COUNTERS];
+  fd[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (fd[0] < 0)
+    return false;
+  fd[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, fd[0]);
+  fd[2] = open_counter(PERF_TYPE_HW_CACHE,
+                       PERF_COUNT_HW_CACHE_L1D |
+                       PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                       PERF_COUNT_HW_CACHE_RESULT_MISS << 16, fd[0]);
+  if (fd[1] < 0 || fd[2] < 0) {
+    for (int i = 0; i < NUM_COUNTERS; i++)
+      if (fd[i] >= 0)
+        close(fd[i]);
+    return false;
+  }
+  ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  group = fd[0];
+  return true;
+}
+
+void counters_read(counters *c)
+{
+  uint64_t v[1 + NUM_COUNTERS]; /* the number of counters, then each */
+  if (group < 0 || read(group, v, sizeof(v)) != sizeof(v)) {
+    memset(c, 0, sizeof(counters));
+    return;
+  }
+  c->cycles = v[1];
+  c->branch_misses = v[2];
+  c->l1d_misses = v[3];
+}
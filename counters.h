@@ -0,0 +1,15 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Hardware counters of the calling thread, see counters.c.
+ */
+
+typedef struct {
+  uint64_t cycles;
+  uint64_t branch_misses;
+  uint64_t l1d_misses;    /* level 1 data cache read misses */
+} counters;
+
+bool counters_open(void);
+void counters_read(counters *c);
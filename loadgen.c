@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "sudoku.h"
+#include "server.h"
+
+/*
+ * Load Generator
+ * ==============
+ *
+ * Measures a solver daemon (sudoku --serve, see server.c) the way
+ * its clients see it.
+ *
+ *   ./sudoku --serve=/tmp/sudoku.sock -j 4 &
+ *   ./loadgen -c 8 -d 16 -n 100000 /tmp/sudoku.sock puzzles/x00
+ *
+ * opens 8 connections, each with a thread which keeps up to 16
+ * requests in flight, and sends 100000 requests in all, going
+ * through the puzzles in the file again and again.  It reports the
+ * requests answered per second and the percentiles of the latency,
+ * the time from sending a request to reading its answer.
+ */
+
+#define BUFFER_SIZE (64 * 1024)
+#define MAX_LINE    (SERVER_MAX_ID + 64 + 2 * SUDOKU_CELLS)
+
+static char const *prog;
+
+static uint64_t now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+typedef struct {
+  char   *text;      /* the puzzles, SUDOKU_CELLS each */
+  size_t  count;
+} puzzle_set;
+
+static bool read_puzzles(char const *path, puzzle_set *ps)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return false;
+  char *line = NULL;
+  size_t cap = 0, room = 0;
+  ssize_t len;
+  ps->text = NULL;
+  ps->count = 0;
+  while ((len = getline(&line, &cap, f)) >= 0) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      len--;
+    if (len == 0)
+      continue;
+    if (ps->count == room) {
+      room = room ? 2 * room : 1024;
+      ps->text = realloc(ps->text, room * SUDOKU_CELLS);
+    }
+    char *p = ps->text + ps->count++ * SUDOKU_CELLS;
+    memset(p, '.', SUDOKU_CELLS);
+    memcpy(p, line, len < SUDOKU_CELLS ? len : SUDOKU_CELLS);
+  }
+  free(line);
+  fclose(f);
+  return true;
+}
+
+/*
+ * Clients
+ * -------
+ *
+ * Client i sends the requests first .. first+count-1, numbered
+ * across all clients so that one array holds every send time and
+ * every latency.
+ */
+
+typedef struct {
+  char const       *path;
+  puzzle_set const *puzzles;
+  long              first, count;
+  int               depth;
+  uint64_t         *sent;
+  uint64_t         *latency;
+  long              errors;
+  bool              failed;
+} client;
+
+static int connect_to(char const *path)
+{
+  struct sockaddr_un a = { .sun_family = AF_UNIX };
+  strncpy(a.sun_path, path, sizeof(a.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr *)&a, sizeof(a)) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+static bool send_all(int fd, char const *b, size_t n)
+{
+  while (n > 0) {
+    ssize_t k = send(fd, b, n, MSG_NOSIGNAL);
+    if (k < 0 && errno == EINTR)
+      continue;
+    if (k < 0)
+      return false;
+    b += k;
+    n -= k;
+  }
+  return true;
+}
+
+/* Send requests next .. until-1 of c in one go. */
+static bool send_requests(client *c, int fd, long next, long until)
+{
+  char out[BUFFER_SIZE];
+  size_t len = 0;
+  for (long id = next; id < until; id++) {
+    if (len + MAX_LINE > sizeof(out)) {
+      if (!send_all(fd, out, len))
+        return false;
+      len = 0;
+    }
+    char const *p = c->puzzles->text + (id % c->puzzles->count) * SUDOKU_CELLS;
+    len += sprintf(out + len, "%ld %.*s\n", id, SUDOKU_CELLS, p);
+  }
+  uint64_t t = now_ns();
+  for (long id = next; id < until; id++)
+    c->sent[id] = t;
+  return send_all(fd, out, len);
+}
+
+static void *client_main(void *arg)
+{
+  client *c = arg;
+  int fd = connect_to(c->path);
+  if (fd < 0) {
+    perror(c->path);
+    c->failed = true;
+    return NULL;
+  }
+
+  long end = c->first + c->count, next = c->first, done = 0;
+  char in[BUFFER_SIZE];
+  size_t in_len = 0;
+  long until = next + c->depth < end ? next + c->depth : end;
+  c->failed = !send_requests(c, fd, next, until);
+  next = until;
+  while (!c->failed && done < c->count) {
+    ssize_t n = recv(fd, in + in_len, sizeof(in) - in_len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      c->failed = true;
+      break;
+    }
+    uint64_t t = now_ns();
+    size_t start = 0, stop = in_len + n;
+    for (char *nl; (nl = memchr(in + start, '\n', stop - start)); ) {
+      char *line = in + start, *rest;
+      long id = strtol(line, &rest, 10);
+      if (rest == line || id < c->first || id >= end ||
+          strncmp(rest, " error", 6) == 0)
+        c->errors++;
+      else
+        c->latency[id] = t - c->sent[id];
+      done++;
+      start = nl + 1 - in;
+    }
+    memmove(in, in + start, stop - start);
+    in_len = stop - start;
+
+    /* one more request for each answer */
+    until = c->first + done + c->depth;
+    if (until > end)
+      until = end;
+    if (until > next) {
+      c->failed = !send_requests(c, fd, next, until);
+      next = until;
+    }
+  }
+  close(fd);
+  return NULL;
+}
+
+/*
+ * Report
+ * ------
+ */
+
+static int compare_u64(void const *a, void const *b)
+{
+  uint64_t x = *(uint64_t const *)a, y = *(uint64_t const *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_us(uint64_t const *sorted, long n, double q)
+{
+  long i = (long)(q * (n - 1) + 0.5);
+  return sorted[i] / 1e3;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: %s [-c connections] [-d depth] [-n requests] socket puzzles\n",
+          prog);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  int connections = 1, depth = 1;
+  long requests = 0;
+  int opt;
+
+  prog = argv[0];
+  while ((opt = getopt(argc, argv, "c:d:n:")) != -1) {
+    switch (opt) {
+    case 'c':
+      connections = atoi(optarg);
+      break;
+    case 'd':
+      depth = atoi(optarg);
+      break;
+    case 'n':
+      requests = atol(optarg);
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind != argc - 2 || connections < 1 || depth < 1 || requests < 0)
+    usage();
+
+  puzzle_set puzzles;
+  if (!read_puzzles(argv[optind + 1], &puzzles)) {
+    perror(argv[optind + 1]);
+    return 1;
+  }
+  if (puzzles.count == 0) {
+    fprintf(stderr, "%s: no puzzles\n", argv[optind + 1]);
+    return 1;
+  }
+  if (requests == 0)
+    requests = puzzles.count;
+
+  uint64_t *sent = calloc(requests, sizeof(uint64_t));
+  uint64_t *latency = calloc(requests, sizeof(uint64_t));
+  client *cs = calloc(connections, sizeof(client));
+  pthread_t *ts = calloc(connections, sizeof(pthread_t));
+  uint64_t start = now_ns();
+  for (int i = 0; i < connections; i++) {
+    client *c = &cs[i];
+    c->path = argv[optind];
+    c->puzzles = &puzzles;
+    c->first = requests * i / connections;
+    c->count = requests * (i + 1) / connections - c->first;
+    c->depth = depth;
+    c->sent = sent;
+    c->latency = latency;
+    pthread_create(&ts[i], NULL, client_main, c);
+  }
+  long errors = 0;
+  bool failed = false;
+  for (int i = 0; i < connections; i++) {
+    pthread_join(ts[i], NULL);
+    errors += cs[i].errors;
+    failed |= cs[i].failed;
+  }
+  double seconds = (now_ns() - start) / 1e9;
+  if (failed) {
+    fprintf(stderr, "%s: lost the connection to the server\n", prog);
+    return 1;
+  }
+
+  qsort(latency, requests, sizeof(uint64_t), compare_u64);
+  printf("%ld requests over %d connection%s, %d deep: %.3f s, %.0f requests/s\n",
+         requests, connections, connections > 1 ? "s" : "", depth, seconds,
+         requests / seconds);
+  printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+         percentile_us(latency, requests, 0.5), percentile_us(latency, requests, 0.9),
+         percentile_us(latency, requests, 0.99), percentile_us(latency, requests, 0.999),
+         latency[requests - 1] / 1e3);
+  if (errors)
+    printf("%ld errors\n", errors);
+  free(ts);
+  free(cs);
+  free(latency);
+  free(sent);
+  free(puzzles.text);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "solver.h"
+#include "lockstep.h"
+
+/*
+ * Lockstep Solving
+ * ================
+ *
+ * Vectorizing within one board still leaves the search one board at
+ * a time.  Here the vectors run across boards instead: each of LANES
+ * lanes holds a puzzle of its own, and cell[p] holds position p of
+ * every lane's board, a digit set per lane.  Propagating, picking the
+ * next position and saving and restoring boards are then the same
+ * vector operations for all lanes at once.
+ *
+ * Each lane runs the reference search, solve() with the MRV and
+ * ASCENDING heuristics, one node per round:
+ *
+ *   1. Naked singles propagate to a fixpoint in every busy lane.  A
+ *      lane that dies here failed to claim its digit, as claim()
+ *      would have, and backtracks; the others enter their node and
+ *      count a choice.
+ *   2. The other singles and locked candidates of the level
+ *      propagate to a fixpoint in the lanes that entered a node, and
+ *      a lane that dies here backtracks.
+ *   3. Each lane still alive either has a solution or branches on
+ *      its position with the fewest digits, trying the lowest digit
+ *      first.  The board before the choice is saved by depth, and
+ *      restored on backtracking to claim the next digit.
+ *
+ * The rules propagate to the same fixpoint in whatever order they
+ * are applied, and die exactly when some order of them would, so the
+ * lanes count the same choices and backtracks and find the same
+ * solutions, in the same order, as solve() does one by one.
+ *
+ * A lane whose puzzle is done takes the next puzzle of the batch.  A
+ * puzzle that needs more than LANE_CHOICES choices (or reaches the
+ * --max-choices budget) overflows: its lane gives it up for the
+ * caller to solve with solve(), so that a hard puzzle can't keep one
+ * lane busy while the batch waits for it.
+ *
+ * Without SSE4.1 every puzzle overflows.
+ */
+
+#define LANE_CHOICES 256
+
+#if defined(__SSE4_1__)
+
+#include <immintrin.h>
+
+#if defined(__AVX2__)
+
+#define LANES 16
+typedef __m256i lanes;
+#define LOAD(p)         _mm256_loadu_si256((__m256i const *)(p))
+#define STORE(p, a)     _mm256_storeu_si256((__m256i *)(p), a)
+#define SET1(x)         _mm256_set1_epi16(x)
+#define ZERO()          _mm256_setzero_si256()
+#define AND(a, b)       _mm256_and_si256(a, b)
+#define OR(a, b)        _mm256_or_si256(a, b)
+#define XOR(a, b)       _mm256_xor_si256(a, b)
+#define ANDNOT(a, b)    _mm256_andnot_si256(a, b)
+#define ADD8(a, b)      _mm256_add_epi8(a, b)
+#define ADD16(a, b)     _mm256_add_epi16(a, b)
+#define SUB16(a, b)     _mm256_sub_epi16(a, b)
+#define SHR16(a, n)     _mm256_srli_epi16(a, n)
+#define SHUFFLE(t, a)   _mm256_shuffle_epi8(t, a)
+#define EQ16(a, b)      _mm256_cmpeq_epi16(a, b)
+#define GT16(a, b)      _mm256_cmpgt_epi16(a, b)
+#define MIN16(a, b)     _mm256_min_epi16(a, b)
+#define BLEND(a, b, m)  _mm256_blendv_epi8(a, b, m)
+#define MOVEMASK(a)     ((unsigned)_mm256_movemask_epi8(a))
+#define NIBBLE_COUNTS   _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, \
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4)
+#define LANE_BITS       _mm256_setr_epi16(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, \
+                                          1 << 6, 1 << 7, 1 << 8, 1 << 9, 1 << 10, 1 << 11, \
+                                          1 << 12, 1 << 13, 1 << 14, -(1 << 15))
+
+#else
+
+#define LANES 8
+typedef __m128i lanes;
+#define LOAD(p)         _mm_loadu_si128((__m128i const *)(p))
+#define STORE(p, a)     _mm_storeu_si128((__m128i *)(p), a)
+#define SET1(x)         _mm_set1_epi16(x)
+#define ZERO()          _mm_setzero_si128()
+#define AND(a, b)       _mm_and_si128(a, b)
+#define OR(a, b)        _mm_or_si128(a, b)
+#define XOR(a, b)       _mm_xor_si128(a, b)
+#define ANDNOT(a, b)    _mm_andnot_si128(a, b)
+#define ADD8(a, b)      _mm_add_epi8(a, b)
+#define ADD16(a, b)     _mm_add_epi16(a, b)
+#define SUB16(a, b)     _mm_sub_epi16(a, b)
+#define SHR16(a, n)     _mm_srli_epi16(a, n)
+#define SHUFFLE(t, a)   _mm_shuffle_epi8(t, a)
+#define EQ16(a, b)      _mm_cmpeq_epi16(a, b)
+#define GT16(a, b)      _mm_cmpgt_epi16(a, b)
+#define MIN16(a, b)     _mm_min_epi16(a, b)
+#define BLEND(a, b, m)  _mm_blendv_epi8(a, b, m)
+#define MOVEMASK(a)     ((unsigned)_mm_movemask_epi8(a))
+#define NIBBLE_COUNTS   _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4)
+#define LANE_BITS       _mm_setr_epi16(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, \
+                                       1 << 6, 1 << 7)
+
+#endif
+
+/* MOVEMASK gives two bits per 16 bit lane. */
+#define LANE_IN(mask, k) (((mask) >> (2 * (k))) & 1)
+
+#define FIXED_KEY 16
+
+typedef struct {
+  pos       pos;
+  digit_set left;       /* the digits still to try */
+} frame;
+
+typedef struct {
+  long  puzzle;         /* index into the batch, -1 if idle */
+  bool  root;           /* the board is the puzzle as loaded */
+  int   depth;
+  frame stack[SUDOKU_SIZE];
+} lane;
+
+struct lockstep {
+  propagation level;
+  long        limit;
+  int         max_sols;
+  int         max_choices;  /* before the puzzle overflows */
+  pos         unit[NUM_UNITS][UNIT_SIZE];
+  pos         band[6][27];  /* 3 lines of 3 segments of 3, see locked_sweep() */
+  lane        lane[LANES];
+  digit_set   cell[SUDOKU_SIZE][LANES];
+  digit_set   saved[SUDOKU_SIZE][SUDOKU_SIZE][LANES];  /* boards by depth */
+};
+
+/* One lane set, the others clear: LANES zeros each side of the one. */
+static const digit_set one_lane[2 * LANES + 1] = { [LANES] = 0xFFFF };
+
+static inline lanes lane_mask(int k)
+{
+  return LOAD(one_lane + LANES - k);
+}
+
+/* The lanes whose bit is set in bits. */
+static inline lanes lanes_of(unsigned bits)
+{
+  lanes b = LANE_BITS;
+  return EQ16(AND(SET1(bits), b), b);
+}
+
+/*
+ * Propagation
+ * -----------
+ *
+ * A sweep goes through the units in place, so what one unit finds is
+ * seen by the next.  In each unit the naked singles are removed from
+ * the other positions, and from level HIDDEN_SINGLES on, a digit left
+ * at only one position is fixed there.  The dead lanes collect in
+ * bad: two positions with the same single digit, an empty position,
+ * a digit with no position, or a position that is the only one for
+ * two digits.  changed collects the lanes that changed.
+ */
+
+static inline lanes single(lanes f)
+{
+  return AND(f, EQ16(AND(f, SUB16(f, SET1(1))), ZERO()));
+}
+
+static void unit_sweep(lockstep *l, propagation level, lanes *changed, lanes *bad)
+{
+  lanes all = SET1(ALL_DIGITS), zero = ZERO(), one = SET1(1);
+  for (int u = 0; u < NUM_UNITS; u++) {
+    pos const *c = l->unit[u];
+    lanes f[UNIT_SIZE], old[UNIT_SIZE], s[UNIT_SIZE];
+    lanes once = zero, twice = zero;
+    for (int i = 0; i < UNIT_SIZE; i++) {
+      old[i] = LOAD(l->cell[c[i]]);
+      s[i] = single(old[i]);
+      twice = OR(twice, AND(once, s[i]));
+      once = OR(once, s[i]);
+    }
+    *bad = OR(*bad, twice);
+    for (int i = 0; i < UNIT_SIZE; i++) {
+      f[i] = ANDNOT(ANDNOT(s[i], once), old[i]);
+      *bad = OR(*bad, EQ16(f[i], zero));
+    }
+
+    if (level >= HIDDEN_SINGLES) {
+      once = twice = zero;
+      for (int i = 0; i < UNIT_SIZE; i++) {
+        twice = OR(twice, AND(once, f[i]));
+        once = OR(once, f[i]);
+      }
+      *bad = OR(*bad, XOR(once, all));
+      lanes hidden = ANDNOT(twice, once);
+      for (int i = 0; i < UNIT_SIZE; i++) {
+        lanes h = AND(f[i], hidden);
+        *bad = OR(*bad, AND(h, SUB16(h, one)));
+        f[i] = OR(h, AND(f[i], EQ16(h, zero)));
+      }
+    }
+
+    for (int i = 0; i < UNIT_SIZE; i++) {
+      *changed = OR(*changed, XOR(f[i], old[i]));
+      STORE(l->cell[c[i]], f[i]);
+    }
+  }
+}
+
+/*
+ * Locked candidates, band by band: the three rows (or columns) of a
+ * band cross its three boxes in nine segments of three positions.
+ * Digits of a segment found nowhere else in its box leave the rest of
+ * its line (pointing), and those found nowhere else in its line leave
+ * the rest of its box (claiming).
+ */
+static void locked_sweep(lockstep *l, lanes *changed, lanes *bad)
+{
+  lanes zero = ZERO();
+  for (int b = 0; b < 6; b++) {
+    pos const *c = l->band[b];
+    lanes seg[3][3], out[3][3];
+    for (int t = 0; t < 3; t++)
+      for (int j = 0; j < 3; j++) {
+        pos const *s = c + t * 9 + j * 3;
+        seg[t][j] = OR(OR(LOAD(l->cell[s[0]]), LOAD(l->cell[s[1]])), LOAD(l->cell[s[2]]));
+        out[t][j] = zero;
+      }
+    for (int t = 0; t < 3; t++)
+      for (int j = 0; j < 3; j++) {
+        int t1 = (t + 1) % 3, t2 = (t + 2) % 3, j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+        lanes line_rest = OR(seg[t][j1], seg[t][j2]);
+        lanes box_rest = OR(seg[t1][j], seg[t2][j]);
+        lanes pointing = ANDNOT(box_rest, seg[t][j]);
+        lanes claiming = ANDNOT(line_rest, seg[t][j]);
+        out[t][j1] = OR(out[t][j1], pointing);
+        out[t][j2] = OR(out[t][j2], pointing);
+        out[t1][j] = OR(out[t1][j], claiming);
+        out[t2][j] = OR(out[t2][j], claiming);
+      }
+    for (int t = 0; t < 3; t++)
+      for (int j = 0; j < 3; j++)
+        for (int i = 0; i < 3; i++) {
+          digit_set *p = l->cell[c[t * 9 + j * 3 + i]];
+          lanes f = LOAD(p), g = ANDNOT(out[t][j], f);
+          *changed = OR(*changed, XOR(f, g));
+          *bad = OR(*bad, EQ16(g, zero));
+          STORE(p, g);
+        }
+  }
+}
+
+/*
+ * Propagate in the lanes of live to a fixpoint of the level's rules.
+ * Returns the MOVEMASK of the lanes that died.
+ */
+static unsigned propagate_lanes(lockstep *l, propagation level, lanes live)
+{
+  lanes dead = ZERO();
+  for (;;) {
+    lanes changed = ZERO(), bad = ZERO();
+    unit_sweep(l, level, &changed, &bad);
+    if (level >= LOCKED_CANDIDATES)
+      locked_sweep(l, &changed, &bad);
+    dead = OR(dead, ANDNOT(EQ16(bad, ZERO()), live));
+    if (MOVEMASK(EQ16(ANDNOT(dead, AND(changed, live)), ZERO())) == MOVEMASK(SET1(-1)))
+      return MOVEMASK(dead);
+  }
+}
+
+/*
+ * The position each lane branches on, as next_move() picks it: the
+ * open position with the fewest digits left, the lowest on ties.
+ * A lane with no open position gets key FIXED_KEY.
+ */
+static void next_moves(lockstep const *l, digit_set *move, digit_set *key)
+{
+  lanes nibble = SET1(0x0F0F), low = SET1(0x00FF), one = SET1(1);
+  lanes fixed = SET1(FIXED_KEY - 1);
+  lanes best = SET1(FIXED_KEY), at = ZERO();
+  for (int p = 0; p < SUDOKU_SIZE; p++) {
+    lanes v = LOAD(l->cell[p]);
+    lanes bytes = ADD8(SHUFFLE(NIBBLE_COUNTS, AND(v, nibble)),
+                       SHUFFLE(NIBBLE_COUNTS, AND(SHR16(v, 4), nibble)));
+    lanes n = ADD16(AND(bytes, low), SHR16(bytes, 8));
+    n = ADD16(n, AND(EQ16(n, one), fixed));
+    at = BLEND(at, SET1(p), GT16(best, n));
+    best = MIN16(best, n);
+  }
+  STORE(move, at);
+  STORE(key, best);
+}
+
+/*
+ * Saving and Restoring
+ * --------------------
+ *
+ * All lanes share saved[depth], each lane its own element of it, so
+ * a board is saved and restored by blending one lane.
+ */
+
+static void save(lockstep *l, int k, int depth)
+{
+  lanes m = lane_mask(k);
+  for (int p = 0; p < SUDOKU_SIZE; p++)
+    STORE(l->saved[depth][p], BLEND(LOAD(l->saved[depth][p]), LOAD(l->cell[p]), m));
+}
+
+static void restore(lockstep *l, int k, int depth)
+{
+  lanes m = lane_mask(k);
+  for (int p = 0; p < SUDOKU_SIZE; p++)
+    STORE(l->cell[p], BLEND(LOAD(l->cell[p]), LOAD(l->saved[depth][p]), m));
+}
+
+/*
+ * Searching
+ * ---------
+ */
+
+static void load(lockstep *l, int k, char const *text, size_t len)
+{
+  for (int p = 0; p < SUDOKU_SIZE; p++) {
+    char c = p < len ? text[p] : '.';
+    l->cell[p][k] = ('1' <= c && c <= '9') ? SET_OF(CHAR_TO_DIGIT(c)) : ALL_DIGITS;
+  }
+}
+
+/*
+ * The node of lane k returned false: count a backtrack in each
+ * parent on the way up, and claim the next digit of the first with
+ * one left.  Returns false if the search is over.
+ */
+static bool backtrack(lockstep *l, int k, lockstep_result *r)
+{
+  lane *a = &l->lane[k];
+  while (a->depth > 0) {
+    frame *f = &a->stack[a->depth - 1];
+    r->backtrack++;
+    if (f->left != NO_DIGITS) {
+      digit d = __builtin_ctz(f->left);
+      f->left &= ~SET_OF(d);
+      restore(l, k, a->depth - 1);
+      l->cell[f->pos][k] = SET_OF(d);
+      return true;
+    }
+    a->depth--;
+  }
+  return false;
+}
+
+static void branch(lockstep *l, int k, pos p)
+{
+  lane *a = &l->lane[k];
+  digit_set dsp = l->cell[p][k];
+  digit d = __builtin_ctz(dsp);
+  save(l, k, a->depth);
+  a->stack[a->depth].pos = p;
+  a->stack[a->depth].left = dsp & ~SET_OF(d);
+  a->depth++;
+  l->cell[p][k] = SET_OF(d);
+}
+
+static void keep_solution(lockstep const *l, int k, lockstep_result *r)
+{
+  if (r->kept < l->max_sols && r->kept < LOCKSTEP_SOLS) {
+    sudoku *s = &r->solution[r->kept++];
+    for (int p = 0; p < SUDOKU_SIZE; p++)
+      s->free[p] = l->cell[p][k];
+  }
+}
+
+/*
+ * One round: every busy lane takes a step of its search.  Returns
+ * the lanes still busy after it.  Lanes backtrack only once the
+ * round's propagation is done, so that the digit each claims next
+ * meets naked singles first, as claim() has it.
+ */
+static unsigned step(lockstep *l, unsigned busy, lockstep_result *results)
+{
+  unsigned dead = propagate_lanes(l, NAKED_SINGLES, lanes_of(busy));
+  unsigned entered = 0, failed = 0;
+  for (int k = 0; k < LANES; k++) {
+    if (!(busy & 1u << k))
+      continue;
+    lane *a = &l->lane[k];
+    lockstep_result *r = &results[a->puzzle];
+    if (LANE_IN(dead, k) && !a->root) {
+      failed |= 1u << k;  /* claim() would have failed */
+      continue;
+    }
+    if (r->choice >= l->max_choices) {
+      r->overflow = true;
+      busy &= ~(1u << k);
+      continue;
+    }
+    r->choice++;
+    a->root = false;
+    if (LANE_IN(dead, k))
+      failed |= 1u << k;
+    else
+      entered |= 1u << k;
+  }
+
+  if (entered) {
+    dead = 0;
+    if (l->level > NAKED_SINGLES)
+      dead = propagate_lanes(l, l->level, lanes_of(entered));
+    digit_set move[LANES], key[LANES];
+    next_moves(l, move, key);
+    for (int k = 0; k < LANES; k++) {
+      if (!(entered & 1u << k))
+        continue;
+      lockstep_result *r = &results[l->lane[k].puzzle];
+      if (LANE_IN(dead, k)) {
+        failed |= 1u << k;
+      } else if (key[k] != FIXED_KEY) {
+        branch(l, k, move[k]);
+      } else {
+        keep_solution(l, k, r);
+        if (++r->found == l->limit)
+          busy &= ~(1u << k);
+        else
+          failed |= 1u << k;
+      }
+    }
+  }
+
+  for (int k = 0; k < LANES; k++)
+    if ((failed & 1u << k) && !backtrack(l, k, &results[l->lane[k].puzzle]))
+      busy &= ~(1u << k);
+  return busy;
+}
+
+lockstep *new_lockstep(options const *o)
+{
+  lockstep *l = malloc(sizeof(lockstep));
+  memset(l, 0, sizeof(lockstep));
+  l->level = o->level;
+  l->limit = o->limit;
+  l->max_sols = o->max_sols;
+  l->max_choices = LANE_CHOICES;
+  if (o->max_choices && o->max_choices < l->max_choices)
+    l->max_choices = o->max_choices;
+  for (int i = 0; i < UNIT_SIZE; i++)
+    for (int j = 0; j < UNIT_SIZE; j++) {
+      l->unit[ROW_UNIT(i)][j] = i * 9 + j;
+      l->unit[COL_UNIT(i)][j] = j * 9 + i;
+      l->unit[BOX_UNIT(i)][j] = (i / 3 * 3 + j / 3) * 9 + i % 3 * 3 + j % 3;
+    }
+  for (int b = 0; b < 3; b++)
+    for (int t = 0; t < 3; t++)
+      for (int j = 0; j < 9; j++) {
+        l->band[b][t * 9 + j] = (b * 3 + t) * 9 + j;
+        l->band[3 + b][t * 9 + j] = j * 9 + b * 3 + t;
+      }
+  for (int k = 0; k < LANES; k++)
+    l->lane[k].puzzle = -1;
+  return l;
+}
+
+void lockstep_solve(lockstep *l, char const *const *line, size_t const *len, size_t n,
+                    lockstep_result *results)
+{
+  size_t next = 0;
+  unsigned busy = 0;
+  for (;;) {
+    for (int k = 0; k < LANES && next < n; k++) {
+      lane *a = &l->lane[k];
+      if (busy & 1u << k)
+        continue;
+      memset(&results[next], 0, sizeof(lockstep_result));
+      load(l, k, line[next], len[next]);
+      a->puzzle = next++;
+      a->root = true;
+      a->depth = 0;
+      busy |= 1u << k;
+    }
+    if (!busy)
+      break;
+    busy = step(l, busy, results);
+  }
+}
+
+#else
+
+struct lockstep {
+  int unused;
+};
+
+lockstep *new_lockstep(options const *o)
+{
+  return malloc(sizeof(lockstep));
+}
+
+void lockstep_solve(lockstep *l, char const *const *line, size_t const *len, size_t n,
+                    lockstep_result *results)
+{
+  for (size_t i = 0; i < n; i++) {
+    memset(&results[i], 0, sizeof(lockstep_result));
+    results[i].overflow = true;
+  }
+}
+
+#endif
+
+lockstep *free_lockstep(lockstep *l)
+{
+  free(l);
+  return NULL;
+}
@@ -0,0 +1,30 @@
+/*
+ * Lockstep solving, see lockstep.c.  Needs solver.h.
+ *
+ *   lockstep *l = new_lockstep(&o);
+ *   lockstep_solve(l, line, len, n, results);
+ *   free_lockstep(l);
+ *
+ * solves the n puzzles line[i] (of len[i] characters, as read) into
+ * results[i].  A result that overflowed is left for the caller to
+ * solve with solve(); any other has the counts and the solutions
+ * solve() would have found, in the order it found them.
+ */
+
+#define LOCKSTEP_SOLS 2  /* solutions kept, at most */
+
+typedef struct {
+  int    choice;
+  int    backtrack;
+  long   found;
+  bool   overflow;       /* too hard for a lane: solve it with solve() */
+  int    kept;
+  sudoku solution[LOCKSTEP_SOLS];
+} lockstep_result;
+
+typedef struct lockstep lockstep;
+
+lockstep *new_lockstep(options const *o);
+lockstep *free_lockstep(lockstep *l);
+void lockstep_solve(lockstep *l, char const *const *line, size_t const *len, size_t n,
+                    lockstep_result *results);
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "packed.h"
+
+/*
+ * Packed Format
+ * =============
+ *
+ * A text puzzle takes a line of 82 bytes and a result line repeats
+ * the puzzle next to its solution and padded counts, nearly 190
+ * bytes in all.  The packed format stores the same information in a
+ * fraction of that.
+ *
+ * A packed file starts with 8 magic bytes, which like PNG's begin
+ * with a byte that is not text and end in "\r\n" so that mangling by
+ * text mode transfers is caught.  The fifth byte tells puzzle files
+ * ('P') from result files ('R'), the sixth is the version.
+ *
+ * Puzzle
+ * ------
+ *
+ * A bitmap of the givens, 11 bytes with cell i at bit i % 8 of byte
+ * i / 8, followed by the digits of the givens in cell order, 4 bits
+ * each, low nibble first, padded to a whole byte.  A puzzle with 25
+ * givens packs into 24 bytes.
+ *
+ * Result
+ * ------
+ *
+ * The puzzle, then the choice count, the backtrack count and the
+ * number of solutions n as unsigned integers, 7 bits per byte, low
+ * bits first, with the top bit set on all but the last byte.  Then n
+ * solutions, each just the digits of the open cells, packed like the
+ * givens.  A puzzle with 25 givens and a unique solution packs into
+ * about 57 bytes.
+ *
+ * Text that doesn't survive the round trip: anything but '1'-'9' in
+ * a puzzle reads back as '.', and short lines read back padded to 81
+ * characters.
+ */
+
+const unsigned char packed_puzzle_magic[PACKED_MAGIC_SIZE] =
+  { 0x93, 'S', 'D', 'K', 'P', 1, '\r', '\n' };
+const unsigned char packed_result_magic[PACKED_MAGIC_SIZE] =
+  { 0x93, 'S', 'D', 'K', 'R', 1, '\r', '\n' };
+
+#define IS_GIVEN(c) ((c) >= '1' && (c) <= '9')
+
+static size_t count_bits(unsigned char const *bitmap)
+{
+  size_t n = 0;
+  for (int i = 0; i < PACKED_BITMAP_SIZE; i++)
+    n += __builtin_popcount(bitmap[i]);
+  return n;
+}
+
+/*
+ * Digits
+ * ------
+ *
+ * Nibble streams: put_digit appends digit c to the stream at b,
+ * whose length in nibbles is *k.
+ */
+
+static void put_digit(unsigned char *b, size_t *k, char c)
+{
+  unsigned char d = c - '0';
+  if (*k % 2 == 0)
+    b[*k / 2] = d;
+  else
+    b[*k / 2] |= d << 4;
+  (*k)++;
+}
+
+static char get_digit(unsigned char const *b, size_t k)
+{
+  unsigned char d = (k % 2 == 0) ? (b[k / 2] & 0xF) : (b[k / 2] >> 4);
+  return (d >= 1 && d <= 9) ? '0' + d : '.';
+}
+
+/*
+ * Puzzles
+ * -------
+ */
+
+/*
+ * Pack the len (at most 81) characters of text into b, which has
+ * room for PACKED_PUZZLE_MAX bytes.  Returns the packed size.
+ */
+size_t pack_puzzle(unsigned char *b, char const *text, size_t len)
+{
+  assert(len <= PACKED_CELLS);
+  unsigned char *digits = b + PACKED_BITMAP_SIZE;
+  size_t k = 0;
+  memset(b, 0, PACKED_BITMAP_SIZE);
+  for (size_t i = 0; i < len; i++)
+    if (IS_GIVEN(text[i])) {
+      b[i / 8] |= 1 << (i % 8);
+      put_digit(digits, &k, text[i]);
+    }
+  return PACKED_BITMAP_SIZE + (k + 1) / 2;
+}
+
+/*
+ * The size of the packed puzzle starting with bitmap, which must
+ * have PACKED_BITMAP_SIZE bytes.
+ */
+size_t packed_puzzle_size(unsigned char const *bitmap)
+{
+  return PACKED_BITMAP_SIZE + (count_bits(bitmap) + 1) / 2;
+}
+
+/*
+ * Unpack the puzzle at b, of which n bytes are available, into the
+ * 81 characters at text.  Returns the packed size, or 0 if the
+ * puzzle is cut short.
+ */
+size_t unpack_puzzle(char *text, unsigned char const *b, size_t n)
+{
+  if (n < PACKED_BITMAP_SIZE)
+    return 0;
+  size_t size = packed_puzzle_size(b);
+  if (n < size)
+    return 0;
+  unsigned char const *digits = b + PACKED_BITMAP_SIZE;
+  size_t k = 0;
+  for (int i = 0; i < PACKED_CELLS; i++)
+    text[i] = (b[i / 8] >> (i % 8) & 1) ? get_digit(digits, k++) : '.';
+  return size;
+}
+
+/*
+ * Solutions
+ * ---------
+ *
+ * Only the open cells of the (81 character) puzzle are stored.
+ */
+
+size_t packed_solution_size(char const *puzzle)
+{
+  size_t open = 0;
+  for (int i = 0; i < PACKED_CELLS; i++)
+    open += !IS_GIVEN(puzzle[i]);
+  return (open + 1) / 2;
+}
+
+size_t pack_solution(unsigned char *b, char const *puzzle, char const *solution)
+{
+  size_t k = 0;
+  for (int i = 0; i < PACKED_CELLS; i++)
+    if (!IS_GIVEN(puzzle[i]))
+      put_digit(b, &k, solution[i]);
+  return (k + 1) / 2;
+}
+
+size_t unpack_solution(char *solution, char const *puzzle, unsigned char const *b, size_t n)
+{
+  size_t size = packed_solution_size(puzzle);
+  if (n < size)
+    return 0;
+  size_t k = 0;
+  for (int i = 0; i < PACKED_CELLS; i++)
+    solution[i] = IS_GIVEN(puzzle[i]) ? puzzle[i] : get_digit(b, k++);
+  return size;
+}
+
+/*
+ * Counts
+ * ------
+ */
+
+size_t pack_uint(unsigned char *b, unsigned long v)
+{
+  size_t k = 0;
+  while (v >= 0x80) {
+    b[k++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  b[k++] = v;
+  return k;
+}
+
+size_t unpack_uint(unsigned long *v, unsigned char const *b, size_t n)
+{
+  *v = 0;
+  for (size_t k = 0; k < n && k < PACKED_UINT_MAX; k++) {
+    *v |= (unsigned long)(b[k] & 0x7F) << (7 * k);
+    if (!(b[k] & 0x80))
+      return k + 1;
+  }
+  return 0;
+}
@@ -0,0 +1,28 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+/*
+ * Packed puzzles and results, see packed.c.  Text puzzles here are
+ * always 81 characters, '1'-'9' for givens and '.' for open cells.
+ */
+
+#define PACKED_CELLS       81
+#define PACKED_MAGIC_SIZE  8
+#define PACKED_BITMAP_SIZE ((PACKED_CELLS + 7) / 8)
+#define PACKED_DIGITS_SIZE ((PACKED_CELLS + 1) / 2)
+#define PACKED_PUZZLE_MAX  (PACKED_BITMAP_SIZE + PACKED_DIGITS_SIZE)
+#define PACKED_UINT_MAX    10
+
+extern const unsigned char packed_puzzle_magic[PACKED_MAGIC_SIZE];
+extern const unsigned char packed_result_magic[PACKED_MAGIC_SIZE];
+
+size_t pack_puzzle(unsigned char *b, char const *text, size_t len);
+size_t unpack_puzzle(char *text, unsigned char const *b, size_t n);
+size_t packed_puzzle_size(unsigned char const *bitmap);
+
+size_t pack_solution(unsigned char *b, char const *puzzle, char const *solution);
+size_t unpack_solution(char *solution, char const *puzzle, unsigned char const *b, size_t n);
+size_t packed_solution_size(char const *puzzle);
+
+size_t pack_uint(unsigned char *b, unsigned long v);
+size_t unpack_uint(unsigned long *v, unsigned char const *b, size_t n);
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <string.h>
+#include <limits.h>
+
+#include "packed.h"
+
+static char const puzzle[] =
+  "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......";
+static char const solution[] =
+  "417369825632158947958724316825437169791586432346912758289643571573291684164875293";
+static char const empty[] =
+  ".................................................................................";
+
+void test_puzzle(void)
+{
+  unsigned char b[PACKED_PUZZLE_MAX];
+  char text[PACKED_CELLS];
+
+  /* 17 givens: the bitmap and 9 bytes of digits */
+  size_t n = pack_puzzle(b, puzzle, PACKED_CELLS);
+  assert(n == PACKED_BITMAP_SIZE + 9);
+  assert(packed_puzzle_size(b) == n);
+  assert(unpack_puzzle(text, b, n) == n);
+  assert(memcmp(text, puzzle, PACKED_CELLS) == 0);
+
+  /* cut short, in the bitmap or in the digits */
+  assert(unpack_puzzle(text, b, 0) == 0);
+  assert(unpack_puzzle(text, b, PACKED_BITMAP_SIZE - 1) == 0);
+  assert(unpack_puzzle(text, b, n - 1) == 0);
+
+  /* no givens, and all of them */
+  assert(pack_puzzle(b, empty, PACKED_CELLS) == PACKED_BITMAP_SIZE);
+  assert(unpack_puzzle(text, b, PACKED_BITMAP_SIZE) == PACKED_BITMAP_SIZE);
+  assert(memcmp(text, empty, PACKED_CELLS) == 0);
+  n = pack_puzzle(b, solution, PACKED_CELLS);
+  assert(n == PACKED_PUZZLE_MAX);
+  assert(unpack_puzzle(text, b, n) == n);
+  assert(memcmp(text, solution, PACKED_CELLS) == 0);
+
+  /* anything but a digit is open, and a short puzzle is padded */
+  n = pack_puzzle(b, "0x 5", 4);
+  assert(unpack_puzzle(text, b, n) == n);
+  assert(memcmp(text, "...5....", 8) == 0 && text[PACKED_CELLS - 1] == '.');
+
+  /* a nibble that isn't a digit reads back as open */
+  n = pack_puzzle(b, "1", 1);
+  b[PACKED_BITMAP_SIZE] = 0xA;
+  assert(unpack_puzzle(text, b, n) == n);
+  assert(text[0] == '.');
+}
+
+void test_solution(void)
+{
+  unsigned char b[PACKED_DIGITS_SIZE];
+  char text[PACKED_CELLS];
+
+  /* 64 open cells */
+  size_t n = pack_solution(b, puzzle, solution);
+  assert(n == 32 && packed_solution_size(puzzle) == n);
+  assert(unpack_solution(text, puzzle, b, n) == n);
+  assert(memcmp(text, solution, PACKED_CELLS) == 0);
+  assert(unpack_solution(text, puzzle, b, n - 1) == 0);
+
+  n = pack_solution(b, empty, solution);
+  assert(n == PACKED_DIGITS_SIZE);
+  assert(unpack_solution(text, empty, b, n) == n);
+  assert(memcmp(text, solution, PACKED_CELLS) == 0);
+
+  /* a full puzzle stores nothing */
+  assert(pack_solution(b, solution, solution) == 0);
+  assert(unpack_solution(text, solution, b, 0) == 0);
+  assert(memcmp(text, solution, PACKED_CELLS) == 0);
+}
+
+void test_uint(void)
+{
+  unsigned long const values[] = {
+    0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, 1234567, ULONG_MAX
+  };
+  size_t const sizes[] = { 1, 1, 1, 2, 2, 3, 3, PACKED_UINT_MAX };
+  unsigned char b[PACKED_UINT_MAX + 1];
+  unsigned long v;
+
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    size_t n = pack_uint(b, values[i]);
+    assert(n == sizes[i]);
+    assert(unpack_uint(&v, b, n) == n && v == values[i]);
+    /* more bytes available change nothing, fewer cut it short */
+    assert(unpack_uint(&v, b, sizeof(b)) == n && v == values[i]);
+    assert(unpack_uint(&v, b, n - 1) == 0);
+  }
+
+  /* a count that doesn't end within PACKED_UINT_MAX bytes */
+  memset(b, 0xFF, sizeof(b));
+  assert(unpack_uint(&v, b, sizeof(b)) == 0);
+}
+
+int main(void)
+{
+  test_puzzle();
+  test_solution();
+  test_uint();
+  return 0;
+}
@@ -0,0 +1,526 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include "sudoku.h"
+#include "server.h"
+
+/*
+ * Server
+ * ======
+ *
+ * sudoku --serve=PATH listens on a Unix domain socket at PATH and
+ * solves puzzles for any number of clients, each of which may send
+ * any number of requests without waiting for the answers:
+ *
+ *   request  ID PUZZLE
+ *   answer   ID SOLUTIONS CHOICES BACKTRACKS SOLUTION
+ *
+ * one per line.  ID is a word of up to SERVER_MAX_ID characters the
+ * client picks to match answers to requests, PUZZLE is a puzzle as
+ * in the files the program reads, and SOLUTION the first solution
+ * found, "-" if there is none or "aborted" if the search gave up
+ * over its budget (--max-choices, --timeout).  A request that can't be read is
+ * answered "ID error" (or "- error" if it has no ID).
+ *
+ * One thread runs an epoll loop which accepts connections, reads
+ * requests and writes answers.  Requests go on a queue for the
+ * worker threads (-j), each of which sets up its solver once (see
+ * sudoku.h) and solves whatever it takes off the queue with
+ * solve_batch().  Answers are queued on their connection as they
+ * are finished, so with several workers they come back out of
+ * order.  SIGINT or SIGTERM stop the server, which then removes the
+ * socket.
+ *
+ * A client that sends faster than it reads is not read from while
+ * its requests in flight and its unsent answers come to more than
+ * CONN_BACKLOG bytes (a request counted at MAX_ANSWER), so neither the
+ * queue nor its buffer can grow without bound.  A client that hangs
+ * up is dropped at once: its requests still queued are solved, but
+ * their answers are thrown away.
+ */
+
+#define MAX_LINE     (SERVER_MAX_ID + 1 + 2 * SUDOKU_CELLS)
+#define READ_SIZE    (64 * 1024)
+#define MAX_ANSWER   (SERVER_MAX_ID + 64 + SUDOKU_CELLS)
+#define WORKER_BATCH 16
+#define MAX_EVENTS   64
+#define CONN_BACKLOG (1 << 20)
+
+typedef struct conn {
+  int    fd;
+  uint32_t events;     /* what epoll waits for */
+  char  *in;           /* requests read, not yet queued */
+  size_t in_len;
+  char  *out;          /* answers not yet written, under the lock */
+  size_t out_start, out_len, out_cap;
+  int    pending;      /* requests queued or being solved */
+  bool   eof;          /* the client sent all it will */
+  bool   dead;         /* the connection failed, drop the answers */
+  bool   ready;        /* on the ready list */
+  bool   closed;
+  struct conn *ready_next;
+  struct conn *next;   /* on the closed list */
+} conn;
+
+typedef struct {
+  conn *c;
+  char  id[SERVER_MAX_ID + 1];
+  char  puzzle[SUDOKU_CELLS];
+} job;
+
+typedef struct {
+  sudoku_config const *config;
+  int    workers;
+  int    epoll_fd;
+  int    listen_fd;
+  bool   accepting;    /* false while out of file descriptors */
+  int    wake_fd;      /* an eventfd the workers signal answers with */
+  pthread_mutex_t lock;
+  pthread_cond_t  more;
+  job   *queue;        /* a ring of cap jobs, count from head */
+  size_t head, count, cap;
+  conn  *ready;        /* connections with new answers */
+  bool   stop;
+} server;
+
+/*
+ * Answers
+ * -------
+ */
+
+/* Append an answer to c.  Called with the lock held. */
+static void put_answer(server *s, conn *c, char const *answer, size_t len)
+{
+  if (!c->dead) {
+    if (c->out_len + len > c->out_cap) {
+      c->out_cap = 2 * (c->out_len + len);
+      c->out = realloc(c->out, c->out_cap);
+    }
+    memcpy(c->out + c->out_len, answer, len);
+    c->out_len += len;
+  }
+  if (!c->ready) {
+    c->ready = true;
+    c->ready_next = s->ready;
+    s->ready = c;
+  }
+}
+
+static void wake(server *s)
+{
+  uint64_t one = 1;
+  if (write(s->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    perror("eventfd");
+}
+
+static void *worker_main(void *arg)
+{
+  server *s = arg;
+  size_t size = solver_size(s->config);
+  sudoku_solver *v = solver_init(malloc(size), size, s->config);
+  job jobs[WORKER_BATCH];
+  char puzzles[WORKER_BATCH * SUDOKU_CELLS];
+  sudoku_result results[WORKER_BATCH];
+
+  pthread_mutex_lock(&s->lock);
+  for (;;) {
+    while (s->count == 0 && !s->stop)
+      pthread_cond_wait(&s->more, &s->lock);
+    if (s->stop)
+      break;
+    /* take a fair share, so that the other workers get some */
+    size_t n = (s->count + s->workers - 1) / s->workers;
+    if (n > WORKER_BATCH)
+      n = WORKER_BATCH;
+    for (size_t i = 0; i < n; i++) {
+      jobs[i] = s->queue[s->head];
+      s->head = (s->head + 1) % s->cap;
+      s->count--;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    for (size_t i = 0; i < n; i++)
+      memcpy(puzzles + i * SUDOKU_CELLS, jobs[i].puzzle, SUDOKU_CELLS);
+    solve_batch(v, puzzles, n, results);
+
+    pthread_mutex_lock(&s->lock);
+    for (size_t i = 0; i < n; i++) {
+      sudoku_result const *r = &results[i];
+      char answer[MAX_ANSWER];
+      int len = r->aborted
+        ? sprintf(answer, "%s %d %d %d aborted\n", jobs[i].id, r->solutions,
+                  r->choices, r->backtracks)
+        : sprintf(answer, "%s %d %d %d %.*s\n", jobs[i].id, r->solutions,
+                  r->choices, r->backtracks,
+                  r->solutions ? SUDOKU_CELLS : 1,
+                  r->solutions ? r->solution : "-");
+      put_answer(s, jobs[i].c, answer, len);
+      jobs[i].c->pending--;
+    }
+    wake(s);
+  }
+  pthread_mutex_unlock(&s->lock);
+  free(v);
+  return NULL;
+}
+
+/*
+ * Connections
+ * -----------
+ */
+
+/* Whether c has too much in flight to read more.  Called with the lock held. */
+static bool backlogged(conn const *c)
+{
+  return c->pending * MAX_ANSWER + (c->out_len - c->out_start) > CONN_BACKLOG;
+}
+
+/* Called with the lock held. */
+static void watch(server *s, conn *c)
+{
+  if (c->dead)
+    return; /* no longer in the epoll set */
+  uint32_t events = (c->eof || backlogged(c)) ? 0 : EPOLLIN;
+  if (c->out_len > c->out_start)
+    events |= EPOLLOUT;
+  if (events != c->events) {
+    struct epoll_event e = { .events = events, .data.ptr = c };
+    epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, c->fd, &e);
+    c->events = events;
+  }
+}
+
+/*
+ * Give up on c: the client is gone or its socket failed.  c leaves the
+ * epoll set, and the answers still to come are dropped until it can be
+ * closed.  Called with the lock held.
+ */
+static void drop(server *s, conn *c)
+{
+  if (!c->dead) {
+    c->dead = true;
+    c->out_start = c->out_len = 0;
+    epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  }
+}
+
+static void write_answers(server *s, conn *c)
+{
+  pthread_mutex_lock(&s->lock);
+  while (c->out_start < c->out_len && !c->dead) {
+    ssize_t n = send(c->fd, c->out + c->out_start, c->out_len - c->out_start,
+                     MSG_NOSIGNAL);
+    if (n >= 0)
+      c->out_start += n;
+    else if (errno == EAGAIN)
+      break;
+    else if (errno != EINTR)
+      drop(s, c);
+  }
+  if (c->dead || c->out_start == c->out_len) {
+    c->out_start = c->out_len = 0;
+  } else if (c->out_start > 0) {
+    memmove(c->out, c->out + c->out_start, c->out_len - c->out_start);
+    c->out_len -= c->out_start;
+    c->out_start = 0;
+  }
+  watch(s, c);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * Close c once it has nothing more to send or can't send it, onto
+ * the closed list to be freed after the current round of events.
+ */
+static void maybe_close(server *s, conn *c, conn **closed)
+{
+  pthread_mutex_lock(&s->lock);
+  bool done = !c->closed && (c->eof || c->dead) && c->pending == 0 &&
+    !c->ready && c->out_len == 0;
+  if (done)
+    c->closed = true;
+  pthread_mutex_unlock(&s->lock);
+  if (done) {
+    if (!c->dead)
+      epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->next = *closed;
+    *closed = c;
+  }
+}
+
+/* Queue the request in line, of len characters.  Called with the lock held. */
+static void put_request(server *s, conn *c, char const *line, size_t len)
+{
+  if (len > 0 && line[len - 1] == '\r')
+    len--;
+  char const *blank = memchr(line, ' ', len);
+  size_t id_len = blank ? (size_t)(blank - line) : len;
+  if (!blank || id_len == 0 || id_len > SERVER_MAX_ID) {
+    char answer[MAX_ANSWER];
+    int n = (id_len > 0 && id_len <= SERVER_MAX_ID)
+      ? sprintf(answer, "%.*s error\n", (int)id_len, line)
+      : sprintf(answer, "- error\n");
+    put_answer(s, c, answer, n);
+    return;
+  }
+
+  if (s->count == s->cap) {
+    size_t cap = s->cap ? 2 * s->cap : 1024;
+    job *q = malloc(cap * sizeof(job));
+    for (size_t i = 0; i < s->count; i++)
+      q[i] = s->queue[(s->head + i) % s->cap];
+    free(s->queue);
+    s->queue = q;
+    s->head = 0;
+    s->cap = cap;
+  }
+  job *j = &s->queue[(s->head + s->count++) % s->cap];
+  j->c = c;
+  memcpy(j->id, line, id_len);
+  j->id[id_len] = '\0';
+  char const *text = blank + 1;
+  size_t text_len = len - id_len - 1;
+  if (text_len > SUDOKU_CELLS)
+    text_len = SUDOKU_CELLS;
+  memset(j->puzzle, '.', SUDOKU_CELLS);
+  memcpy(j->puzzle, text, text_len);
+  c->pending++;
+}
+
+static void read_requests(server *s, conn *c)
+{
+  for (;;) {
+    ssize_t n = recv(c->fd, c->in + c->in_len, READ_SIZE, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EAGAIN)
+      break;
+    pthread_mutex_lock(&s->lock);
+    if (n <= 0) {
+      if (n < 0)
+        drop(s, c);
+      c->eof = true;
+    }
+    size_t start = 0, end = c->in_len + (n > 0 ? n : 0);
+    for (char *nl; (nl = memchr(c->in + start, '\n', end - start)); ) {
+      put_request(s, c, c->in + start, nl - (c->in + start));
+      start = nl + 1 - c->in;
+    }
+    if (c->eof && start < end && !c->dead) {
+      /* the last request need not end in a newline */
+      put_request(s, c, c->in + start, end - start);
+      start = end;
+    } else if (end - start > MAX_LINE) {
+      put_answer(s, c, "- error\n", 8);
+      c->eof = true;
+      start = end;
+    }
+    memmove(c->in, c->in + start, end - start);
+    c->in_len = end - start;
+    pthread_cond_broadcast(&s->more);
+    watch(s, c);
+    bool more = !c->eof && !backlogged(c);
+    pthread_mutex_unlock(&s->lock);
+    if (!more)
+      break;
+  }
+}
+
+/* Stop or resume taking connections. */
+static void set_accepting(server *s, bool accepting)
+{
+  struct epoll_event e = {
+    .events = accepting ? EPOLLIN : 0, .data.ptr = &s->accepting
+  };
+  epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, s->listen_fd, &e);
+  s->accepting = accepting;
+}
+
+static void accept_clients(server *s)
+{
+  for (;;) {
+    int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EAGAIN)
+        return;
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      /*
+       * Out of file descriptors or memory: the listener stays
+       * readable, so stop watching it until a connection closes.
+       */
+      perror("accept");
+      set_accepting(s, false);
+      return;
+    }
+    conn *c = calloc(1, sizeof(conn));
+    c->fd = fd;
+    c->in = malloc(MAX_LINE + READ_SIZE);
+    c->events = EPOLLIN;
+    struct epoll_event e = { .events = EPOLLIN, .data.ptr = c };
+    epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &e);
+  }
+}
+
+static void free_conns(conn *c)
+{
+  while (c) {
+    conn *next = c->next;
+    free(c->in);
+    free(c->out);
+    free(c);
+    c = next;
+  }
+}
+
+/*
+ * The Loop
+ * --------
+ */
+
+static int listen_on(char const *path)
+{
+  struct sockaddr_un a = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof(a.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return -1;
+  }
+  strcpy(a.sun_path, path);
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path); /* left behind by an earlier server */
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&a, sizeof(a)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    perror(path);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int run_server(char const *path, sudoku_config const *config, int workers)
+{
+  static int wake_tag, signal_tag;
+  server s = { .config = config, .workers = workers, .accepting = true };
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  int listen_fd = listen_on(path);
+  if (listen_fd < 0)
+    return 1;
+  s.listen_fd = listen_fd;
+  int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  s.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  s.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event e = { .events = EPOLLIN };
+  e.data.ptr = &s.accepting;
+  epoll_ctl(s.epoll_fd, EPOLL_CTL_ADD, listen_fd, &e);
+  e.data.ptr = &wake_tag;
+  epoll_ctl(s.epoll_fd, EPOLL_CTL_ADD, s.wake_fd, &e);
+  e.data.ptr = &signal_tag;
+  epoll_ctl(s.epoll_fd, EPOLL_CTL_ADD, signal_fd, &e);
+
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.more, NULL);
+  pthread_t *ts = calloc(workers, sizeof(pthread_t));
+  for (int i = 0; i < workers; i++)
+    pthread_create(&ts[i], NULL, worker_main, &s);
+  fprintf(stderr, "serving on %s with %d worker%s\n", path, workers,
+          workers > 1 ? "s" : "");
+
+  struct epoll_event events[MAX_EVENTS];
+  bool running = true;
+  while (running) {
+    int n = epoll_wait(s.epoll_fd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      break;
+    }
+    conn *closed = NULL;
+    for (int i = 0; i < n; i++) {
+      void *tag = events[i].data.ptr;
+      if (tag == &s.accepting) {
+        accept_clients(&s);
+      } else if (tag == &signal_tag) {
+        running = false;
+      } else if (tag == &wake_tag) {
+        uint64_t count;
+        if (read(s.wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+          perror("eventfd");
+        /*
+         * The connections taken stay marked ready, so that no worker
+         * links them anew, until each is unlinked under the lock.
+         */
+        pthread_mutex_lock(&s.lock);
+        conn *ready = s.ready;
+        s.ready = NULL;
+        pthread_mutex_unlock(&s.lock);
+        while (ready) {
+          pthread_mutex_lock(&s.lock);
+          conn *c = ready;
+          ready = c->ready_next;
+          c->ready = false;
+          pthread_mutex_unlock(&s.lock);
+          write_answers(&s, c);
+          maybe_close(&s, c, &closed);
+        }
+      } else {
+        conn *c = tag;
+        if (c->closed || c->dead)
+          continue;
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+          pthread_mutex_lock(&s.lock);
+          drop(&s, c);
+          pthread_mutex_unlock(&s.lock);
+        } else {
+          if ((events[i].events & EPOLLIN) && !c->eof)
+            read_requests(&s, c);
+          if (events[i].events & EPOLLOUT)
+            write_answers(&s, c);
+        }
+        maybe_close(&s, c, &closed);
+      }
+    }
+    if (closed && !s.accepting)
+      set_accepting(&s, true);
+    free_conns(closed);
+  }
+
+  pthread_mutex_lock(&s.lock);
+  s.stop = true;
+  pthread_cond_broadcast(&s.more);
+  pthread_mutex_unlock(&s.lock);
+  for (int i = 0; i < workers; i++)
+    pthread_join(ts[i], NULL);
+  free(ts);
+  free(s.queue);
+  close(listen_fd);
+  unlink(path);
+  close(signal_fd);
+  close(s.wake_fd);
+  close(s.epoll_fd);
+  return 0;
+}
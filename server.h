@@ -0,0 +1,9 @@
+/*
+ * The solver daemon, see server.c.  Serves puzzles on the Unix
+ * domain socket at path with workers threads until interrupted.
+ * Returns the exit status.  Needs sudoku.h.
+ */
+int run_server(char const *path, sudoku_config const *c, int workers);
+
+/* The longest request id. */
+#define SERVER_MAX_ID 32
@@ -0,0 +1,2071 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "solver.h"
+
+/*
+ * The Solver
+ * ==========
+ *
+ * Everything about solving a single puzzle: the board and its
+ * propagation, the engines, the grader and the text form of a
+ * sudoku.  Built into libsudoku, see sudoku.h for the interface it
+ * exports and solver.h for the internals shared with the sudoku
+ * program.
+ */
+
+/*
+ * For each position, we record the positions of its 20 neighbors.
+ *
+ * This array was computed once with a separate program and then
+ * simply include here, which is more efficient than computing it
+ * every time the program starts up.
+ */
+static const pos neighbors[SUDOKU_SIZE][NUM_NEIGHBORS] = {
+    { 1, 9, 2,18, 3,27, 4,36,10, 5,45,11, 6,54, 7,63,19, 8,72,20},
+    { 0,10, 2,19, 3,28, 9, 4,37, 5,46,11, 6,55,18, 7,64, 8,73,20},
+    { 0, 1,11,20, 3,29, 9, 4,38,10, 5,47, 6,56,18, 7,65,19, 8,74},
+    { 0, 1,12, 4, 2,21, 5,30,39,13,48,14, 6,57, 7,66,22, 8,75,23},
+    { 0, 3, 1,13, 2,22, 5,31,12,40,49,14, 6,58,21, 7,67, 8,76,23},
+    { 0, 3, 1,14, 4, 2,23,32,12,41,13,50, 6,59,21, 7,68,22, 8,77},
+    { 0, 1,15, 7, 2,24, 8, 3,33, 4,42,16, 5,51,17,60,69,25,78,26},
+    { 0, 6, 1,16, 2,25, 8, 3,34,15, 4,43, 5,52,17,61,24,70,79,26},
+    { 0, 6, 1,17, 7, 2,26, 3,35,15, 4,44,16, 5,53,62,24,71,25,80},
+    { 0,10, 1,11,18, 2,12,27,13,36,14,45,15,54,16,63,19,17,72,20},
+    { 9, 1, 0,11,19, 2,12,28,13,37,14,46,15,55,18,16,64,17,73,20},
+    { 9, 2, 0,10, 1,20,12,29,13,38,14,47,15,56,18,16,65,19,17,74},
+    { 9, 3,10, 4,11,21, 5,30,13,39,14,48,15,57,16,66,22,17,75,23},
+    { 9, 4, 3,10,11,22, 5,12,31,40,14,49,15,58,21,16,67,17,76,23},
+    { 9, 5, 3,10, 4,11,23,12,32,13,41,50,15,59,21,16,68,22,17,77},
+    { 9, 6,10, 7,11,24, 8,12,33,13,42,16,14,51,17,60,69,25,78,26},
+    { 9, 7, 6,10,11,25, 8,12,34,15,13,43,14,52,17,61,24,70,79,26},
+    { 9, 8, 6,10, 7,11,26,12,35,15,13,44,16,14,53,62,24,71,25,80},
+    { 0,19, 9, 1,20, 2,21,27,22,36,10,23,45,11,24,54,25,63,26,72},
+    {18, 1, 0,10,20, 2,21,28, 9,22,37,23,46,11,24,55,25,64,26,73},
+    {18, 2, 0,19,11, 1,21,29, 9,22,38,10,23,47,24,56,25,65,26,74},
+    {18, 3,19,12, 4,20, 5,30,22,39,13,23,48,14,24,57,25,66,26,75},
+    {18, 4, 3,19,13,20, 5,21,31,12,40,23,49,14,24,58,25,67,26,76},
+    {18, 5, 3,19,14, 4,20,21,32,12,22,41,13,50,24,59,25,68,26,77},
+    {18, 6,19,15, 7,20, 8,21,33,22,42,16,23,51,17,60,25,69,26,78},
+    {18, 7, 6,19,16,20, 8,21,34,15,22,43,23,52,17,24,61,70,26,79},
+    {18, 8, 6,19,17, 7,20,21,35,15,22,44,16,23,53,24,62,25,71,80},
+    { 0,28, 9,29,18,30,36,31,37,32,45,38,33,54,34,63,46,35,72,47},
+    {27, 1,10,29,19,30,36,31,37,32,46,38,33,55,45,34,64,35,73,47},
+    {27, 2,28,11,20,30,36,31,38,37,32,47,33,56,45,34,65,46,35,74},
+    {27, 3,28,12,31,29,21,32,39,40,48,41,33,57,34,66,49,35,75,50},
+    {27, 4,30,28,13,29,22,32,39,40,49,41,33,58,48,34,67,35,76,50},
+    {27, 5,30,28,14,31,29,23,39,41,40,50,33,59,48,34,68,49,35,77},
+    {27, 6,28,15,34,29,24,35,30,42,31,43,32,51,44,60,69,52,78,53},
+    {27, 7,33,28,16,29,25,35,30,42,31,43,32,52,44,61,51,70,79,53},
+    {27, 8,33,28,17,34,29,26,30,42,31,44,43,32,53,62,51,71,52,80},
+    { 0,27,37, 9,28,38,18,29,39,40,41,45,42,54,43,63,46,44,72,47},
+    {36, 1,27,10,28,38,19,29,39,40,41,46,42,55,45,43,64,44,73,47},
+    {36, 2,27,37,11,28,20,29,39,40,41,47,42,56,45,43,65,46,44,74},
+    {36, 3,30,37,12,31,38,21,32,40,41,48,42,57,43,66,49,44,75,50},
+    {36, 4,30,37,13,31,38,22,32,39,41,49,42,58,48,43,67,44,76,50},
+    {36, 5,30,37,14,31,38,23,32,39,40,50,42,59,48,43,68,49,44,77},
+    {36, 6,33,37,15,34,38,24,35,39,40,43,41,51,44,60,69,52,78,53},
+    {36, 7,33,37,16,34,38,25,35,39,42,40,41,52,44,61,51,70,79,53},
+    {36, 8,33,37,17,34,38,26,35,39,42,40,43,41,53,62,51,71,52,80},
+    { 0,27,46, 9,28,47,18,29,48,36,49,37,50,38,51,54,52,63,53,72},
+    {45, 1,27,10,28,47,19,29,48,36,49,37,50,38,51,55,52,64,53,73},
+    {45, 2,27,46,11,28,20,29,48,36,49,38,37,50,51,56,52,65,53,74},
+    {45, 3,30,46,12,31,47,21,32,39,49,40,50,41,51,57,52,66,53,75},
+    {45, 4,30,46,13,31,47,22,32,48,39,40,50,41,51,58,52,67,53,76},
+    {45, 5,30,46,14,31,47,23,32,48,39,49,41,40,51,59,52,68,53,77},
+    {45, 6,33,46,15,34,47,24,35,48,42,49,43,50,44,60,52,69,53,78},
+    {45, 7,33,46,16,34,47,25,35,48,42,49,43,50,44,51,61,70,53,79},
+    {45, 8,33,46,17,34,47,26,35,48,42,49,44,43,50,51,62,52,71,80},
+    { 0,55, 9,56,18,57,27,63,58,36,64,59,45,65,60,72,61,73,62,74},
+    {54, 1,10,56,19,57,28,63,58,37,64,59,46,65,60,72,61,73,62,74},
+    {54, 2,55,11,20,57,29,63,58,38,64,59,47,65,60,72,61,73,62,74},
+    {54, 3,55,12,58,56,21,59,30,66,39,67,48,68,60,75,61,76,62,77},
+    {54, 4,57,55,13,56,22,59,31,66,40,67,49,68,60,75,61,76,62,77},
+    {54, 5,57,55,14,58,56,23,32,66,41,67,50,68,60,75,61,76,62,77},
+    {54, 6,55,15,61,56,24,62,57,33,69,58,42,70,59,51,71,78,79,80},
+    {54, 7,60,55,16,56,25,62,57,34,69,58,43,70,59,52,71,78,79,80},
+    {54, 8,60,55,17,61,56,26,57,35,69,58,44,70,59,53,71,78,79,80},
+    { 0,54,64, 9,55,65,18,56,66,27,67,36,68,45,69,72,70,73,71,74},
+    {63, 1,54,10,55,65,19,56,66,28,67,37,68,46,69,72,70,73,71,74},
+    {63, 2,54,64,11,55,20,56,66,29,67,38,68,47,69,72,70,73,71,74},
+    {63, 3,57,64,12,58,65,21,59,30,67,39,68,48,69,75,70,76,71,77},
+    {63, 4,57,64,13,58,65,22,59,66,31,40,68,49,69,75,70,76,71,77},
+    {63, 5,57,64,14,58,65,23,59,66,32,67,41,50,69,75,70,76,71,77},
+    {63, 6,60,64,15,61,65,24,62,66,33,67,42,70,68,51,71,78,79,80},
+    {63, 7,60,64,16,61,65,25,62,66,34,69,67,43,68,52,71,78,79,80},
+    {63, 8,60,64,17,61,65,26,62,66,35,69,67,44,70,68,53,78,79,80},
+    { 0,54,73, 9,55,74,18,56,75,27,63,76,36,64,77,45,65,78,79,80},
+    {72, 1,54,10,55,74,19,56,75,28,63,76,37,64,77,46,65,78,79,80},
+    {72, 2,54,73,11,55,20,56,75,29,63,76,38,64,77,47,65,78,79,80},
+    {72, 3,57,73,12,58,74,21,59,30,66,76,39,67,77,48,68,78,79,80},
+    {72, 4,57,73,13,58,74,22,59,75,31,66,40,67,77,49,68,78,79,80},
+    {72, 5,57,73,14,58,74,23,59,75,32,66,76,41,67,50,68,78,79,80},
+    {72, 6,60,73,15,61,74,24,62,75,33,69,76,42,70,77,51,71,79,80},
+    {72, 7,60,73,16,61,74,25,62,75,34,69,76,43,70,77,52,71,78,80},
+    {72, 8,60,73,17,61,74,26,62,75,35,69,76,44,70,77,53,71,78,79}
+  };
+
+static const pos units[NUM_UNITS][UNIT_SIZE] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8},
+    { 9,10,11,12,13,14,15,16,17},
+    {18,19,20,21,22,23,24,25,26},
+    {27,28,29,30,31,32,33,34,35},
+    {36,37,38,39,40,41,42,43,44},
+    {45,46,47,48,49,50,51,52,53},
+    {54,55,56,57,58,59,60,61,62},
+    {63,64,65,66,67,68,69,70,71},
+    {72,73,74,75,76,77,78,79,80},
+    { 0, 9,18,27,36,45,54,63,72},
+    { 1,10,19,28,37,46,55,64,73},
+    { 2,11,20,29,38,47,56,65,74},
+    { 3,12,21,30,39,48,57,66,75},
+    { 4,13,22,31,40,49,58,67,76},
+    { 5,14,23,32,41,50,59,68,77},
+    { 6,15,24,33,42,51,60,69,78},
+    { 7,16,25,34,43,52,61,70,79},
+    { 8,17,26,35,44,53,62,71,80},
+    { 0, 1, 2, 9,10,11,18,19,20},
+    { 3, 4, 5,12,13,14,21,22,23},
+    { 6, 7, 8,15,16,17,24,25,26},
+    {27,28,29,36,37,38,45,46,47},
+    {30,31,32,39,40,41,48,49,50},
+    {33,34,35,42,43,44,51,52,53},
+    {54,55,56,63,64,65,72,73,74},
+    {57,58,59,66,67,68,75,76,77},
+    {60,61,62,69,70,71,78,79,80}
+  };
+
+/*
+ * Statistics
+ * ----------
+ *
+ * Built with STATS defined (make STATS=1), propagation and the
+ * reference and trail searches count their work into a stats record
+ * per thread, which thread_stats() returns for the caller to clear
+ * and read around each puzzle.  Times are split by reading the time
+ * stamp counter, where there is one, before and after each part.
+ * Built without, the STAT_ macros are empty and the code is as fast
+ * as ever.
+ */
+
+#ifdef STATS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICKS() __rdtsc()
+#else
+static inline uint64_t TICKS(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+#endif
+
+static __thread stats solver_stats;
+
+stats *thread_stats(void)
+{
+  return &solver_stats;
+}
+
+#define STAT_ADD(f, n)    (solver_stats.f += (n))
+#define STAT_MAX(f, n)    do { if ((n) > solver_stats.f) solver_stats.f = (n); } while (0)
+#define STAT_PUSH()       do { solver_stats.depth++; STAT_MAX(max_depth, solver_stats.depth); } while (0)
+#define STAT_POP()        (solver_stats.depth--)
+#define STAT_CLOCK(t)     uint64_t t = TICKS()
+#define STAT_SPLIT(t, f)  do { uint64_t now = TICKS(); solver_stats.f += now - t; t = now; } while (0)
+
+#else
+
+#define STAT_ADD(f, n)
+#define STAT_MAX(f, n)
+#define STAT_PUSH()
+#define STAT_POP()
+#define STAT_CLOCK(t)
+#define STAT_SPLIT(t, f)
+
+#endif
+
+/*
+ * Propagation
+ * -----------
+ *
+ * Revoking the digits ds from the neighbors of p may leave some
+ * neighbor with a single possible digit, which must then be revoked
+ * from its neighbors in turn, and so on.
+ *
+ * Rather than recursing, revoke() keeps a queue of the positions
+ * whose digit still has to be revoked from their neighbors.  A
+ * position enters the queue only when it goes from several digits to
+ * one, which happens at most once, so the queue never holds more
+ * than SUDOKU_SIZE entries.
+ *
+ * Revoking stops as soon as some position has no digit left, and
+ * returns false: the sudoku can't be solved, and there's no point in
+ * propagating any further.
+ */
+
+static inline void set_free(sudoku *s, trail *t, pos p, digit_set ds)
+{
+  if (t) {
+    t->top->pos = p;
+    t->top->old = s->free[p];
+    t->top++;
+  }
+  s->free[p] = ds;
+}
+
+static inline void undo(sudoku *s, trail *t, trail_entry *mark)
+{
+  while (t->top > mark) {
+    t->top--;
+    s->free[t->top->pos] = t->top->old;
+  }
+}
+
+typedef struct {
+  trail    *trail;
+  pos       pos[SUDOKU_SIZE];
+  digit_set ds[SUDOKU_SIZE];
+  int       head, tail;
+} revoke_queue;
+
+static inline bool revoke_from(sudoku *s, revoke_queue *q, pos p, digit_set ds)
+{
+  digit_set f = s->free[p];
+  if (!(f & ds))
+    return true;
+  STAT_ADD(eliminations, SET_SIZE(f & ds));
+  set_free(s, q->trail, p, f &= ~ds);
+  if (f == NO_DIGITS)
+    return false;
+  if (SET_SIZE(f) == 1) {
+    q->pos[q->tail] = p;
+    q->ds[q->tail++] = f;
+    STAT_MAX(max_queue, q->tail);
+  }
+  return true;
+}
+
+static bool revoke_drain(sudoku *s, revoke_queue *q)
+{
+  while (q->head < q->tail) {
+    pos p = q->pos[q->head];
+    digit_set ds = q->ds[q->head++];
+    for (int i = 0; i < NUM_NEIGHBORS; i++)
+      if (!revoke_from(s, q, neighbors[p][i], ds))
+        return false;
+  }
+  return true;
+}
+
+bool revoke(sudoku *s, pos p, digit_set ds, trail *t)
+{
+  revoke_queue q;
+  STAT_ADD(revokes, 1);
+  q.trail = t;
+  q.head = q.tail = 0;
+  q.pos[q.tail] = p;
+  q.ds[q.tail++] = ds;
+  return revoke_drain(s, &q);
+}
+
+/*
+ * Remove the digits ds from the digits possible at position p, and
+ * propagate if that leaves a single digit.
+ */
+bool eliminate(sudoku *s, pos p, digit_set ds, trail *t)
+{
+  revoke_queue q;
+  STAT_ADD(revokes, 1);
+  q.trail = t;
+  q.head = q.tail = 0;
+  return revoke_from(s, &q, p, ds) && revoke_drain(s, &q);
+}
+
+bool claim(sudoku *s, pos p, digit d, trail *t)
+{
+  assert(IN_SET(s->free[p], d));
+  set_free(s, t, p, SET_OF(d));
+  return revoke(s, p, SET_OF(d), t);
+}
+
+/*
+ * Unit Propagation
+ * ----------------
+ *
+ * claim() and revoke() only notice naked singles: positions left
+ * with a single possible digit.  Looking at whole units finds more:
+ *
+ * A hidden single is a digit that is possible at only one position
+ * of some unit, which must then hold that digit.
+ *
+ * Locked candidates arise where a box crosses a row or column.  If
+ * within the box a digit is only possible in the crossing, it can't
+ * appear in the rest of the row or column (pointing), and if within
+ * the row or column it's only possible in the crossing, it can't
+ * appear in the rest of the box (claiming).
+ *
+ * Each level includes the ones before it.  Propagation repeats until
+ * nothing changes and returns false as soon as it finds that the
+ * sudoku can not be solved.
+ */
+
+static bool hidden_singles(sudoku *s, bool *changed, trail *t)
+{
+  for (int u = 0; u < NUM_UNITS; u++) {
+    digit_set once = NO_DIGITS, twice = NO_DIGITS;
+    for (int i = 0; i < UNIT_SIZE; i++) {
+      digit_set f = s->free[units[u][i]];
+      twice |= once & f;
+      once |= f;
+    }
+    if (once != ALL_DIGITS)
+      return false; /* some digit has no place left in this unit */
+
+    digit_set hidden = once & ~twice;
+    if (hidden == NO_DIGITS)
+      continue;
+    for (int i = 0; i < UNIT_SIZE; i++) {
+      pos p = units[u][i];
+      digit_set h = s->free[p] & hidden;
+      if (h == NO_DIGITS)
+        continue;
+      if (SET_SIZE(h) > 1)
+        return false; /* two digits with only this place to go */
+      if (h != s->free[p]) {
+        set_free(s, t, p, h);
+        if (!revoke(s, p, h, t))
+          return false;
+        *changed = true;
+      }
+    }
+  }
+  return true;
+}
+
+static inline bool on_line(pos p, int line)
+{
+  return line < 9 ? ROW_OF(p) == line : COL_OF(p) == line - 9;
+}
+
+static bool locked_candidates(sudoku *s, bool *changed, trail *t)
+{
+  for (int b = 0; b < 9; b++) {
+    pos const *box = units[BOX_UNIT(b)];
+    for (int k = 0; k < 6; k++) {
+      int line = (k < 3) ? ROW_UNIT(b / 3 * 3 + k) : COL_UNIT(b % 3 * 3 + k - 3);
+      pos const *cells = units[line];
+      digit_set cross = NO_DIGITS, box_rest = NO_DIGITS, line_rest = NO_DIGITS;
+      for (int i = 0; i < UNIT_SIZE; i++) {
+        if (on_line(box[i], line))
+          cross |= s->free[box[i]];
+        else
+          box_rest |= s->free[box[i]];
+        if (BOX_OF(cells[i]) != b)
+          line_rest |= s->free[cells[i]];
+      }
+      digit_set pointing = cross & ~box_rest & line_rest;
+      digit_set claiming = cross & ~line_rest & box_rest;
+      for (int i = 0; i < UNIT_SIZE; i++) {
+        pos p = cells[i];
+        if (BOX_OF(p) != b && (s->free[p] & pointing)) {
+          if (!eliminate(s, p, pointing, t))
+            return false;
+          *changed = true;
+        }
+        p = box[i];
+        if (!on_line(p, line) && (s->free[p] & claiming)) {
+          if (!eliminate(s, p, claiming, t))
+            return false;
+          *changed = true;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool propagate(sudoku *s, propagation level, trail *t)
+{
+  bool changed;
+  if (level == NAKED_SINGLES)
+    return true;
+  do {
+    changed = false;
+    if (level >= HIDDEN_SINGLES && !hidden_singles(s, &changed, t))
+      return false;
+    if (!changed && level >= LOCKED_CANDIDATES && !locked_candidates(s, &changed, t))
+      return false;
+  } while (changed);
+  return true;
+}
+
+
+/*
+ * Find the position which we'll next try to solve for.
+ *
+ * If the position returned has 0 degrees of freedom, then the
+ * puzzle's current configuration violates the rules of sudoku and
+ * cann not be solved.
+ *
+ * If the position returned has 1 degree of freedom, then the puzzle
+ * has been successfully solved.
+ *
+ * If the position returned has 2 or more degrees of freedom, then the
+ * possible digits should be explored until a solution is found.
+ */
+#if defined(__SSE4_1__)
+
+/*
+ * Vectorized next_move
+ * --------------------
+ *
+ * The same choice can be made with a few vector operations over the
+ * whole board.  Each position gets a key: its number of possible
+ * digits, except that fixed positions (one digit) get a key larger
+ * than any count so they never win.  The smallest key then names
+ * the position next_move() would pick, and the first position
+ * holding it breaks ties by lowest position as the loop does.
+ *
+ * The counts come from a nibble popcount table looked up with a
+ * byte shuffle.  SSE4.1 provides an unsigned 16 bit minimum and a
+ * horizontal minimum (minpos).  With AVX2 we process 16 positions at
+ * a time and fold to 8 lanes before taking the horizontal minimum.
+ *
+ * The board is not padded, so the last vector is loaded so that it
+ * ends at position 80, overlapping its predecessor.  That does no
+ * harm: the overlapping positions are compared twice but the first
+ * match is always found first.
+ */
+
+#include <immintrin.h>
+
+#define FIXED_KEY 16
+
+#if defined(__AVX2__)
+
+#define LANES 16
+typedef __m256i lanes;
+#define LOAD(p)         _mm256_loadu_si256((__m256i const *)(p))
+#define SET1(x)         _mm256_set1_epi16(x)
+#define AND(a, b)       _mm256_and_si256(a, b)
+#define ADD8(a, b)      _mm256_add_epi8(a, b)
+#define ADD16(a, b)     _mm256_add_epi16(a, b)
+#define SHR16(a, n)     _mm256_srli_epi16(a, n)
+#define SHUFFLE(t, a)   _mm256_shuffle_epi8(t, a)
+#define EQ16(a, b)      _mm256_cmpeq_epi16(a, b)
+#define MIN16(a, b)     _mm256_min_epu16(a, b)
+#define MOVEMASK(a)     _mm256_movemask_epi8(a)
+#define NIBBLE_COUNTS   _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, \
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4)
+#define FOLD(a)         _mm_min_epu16(_mm256_castsi256_si128(a), \
+                                      _mm256_extracti128_si256(a, 1))
+
+#else
+
+#define LANES 8
+typedef __m128i lanes;
+#define LOAD(p)         _mm_loadu_si128((__m128i const *)(p))
+#define SET1(x)         _mm_set1_epi16(x)
+#define AND(a, b)       _mm_and_si128(a, b)
+#define ADD8(a, b)      _mm_add_epi8(a, b)
+#define ADD16(a, b)     _mm_add_epi16(a, b)
+#define SHR16(a, n)     _mm_srli_epi16(a, n)
+#define SHUFFLE(t, a)   _mm_shuffle_epi8(t, a)
+#define EQ16(a, b)      _mm_cmpeq_epi16(a, b)
+#define MIN16(a, b)     _mm_min_epu16(a, b)
+#define MOVEMASK(a)     _mm_movemask_epi8(a)
+#define NIBBLE_COUNTS   _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4)
+#define FOLD(a)         (a)
+
+#endif
+
+#define NUM_VECTORS ((SUDOKU_SIZE + LANES - 1) / LANES)
+
+static inline lanes move_keys(digit_set const *free)
+{
+  lanes v = LOAD(free);
+  lanes nibble = SET1(0x0F0F);
+  lanes bytes = ADD8(SHUFFLE(NIBBLE_COUNTS, AND(v, nibble)),
+                     SHUFFLE(NIBBLE_COUNTS, AND(SHR16(v, 4), nibble)));
+  lanes n = ADD16(AND(bytes, SET1(0x00FF)), SHR16(bytes, 8));
+  return ADD16(n, AND(EQ16(n, SET1(1)), SET1(FIXED_KEY - 1)));
+}
+
+pos next_move(solver const *s)
+{
+  lanes key[NUM_VECTORS];
+  int offset[NUM_VECTORS];
+  lanes m = SET1(-1);
+  for (int i = 0; i < NUM_VECTORS; i++) {
+    offset[i] = (i < NUM_VECTORS - 1) ? i * LANES : SUDOKU_SIZE - LANES;
+    key[i] = move_keys(s->sudoku.free + offset[i]);
+    m = MIN16(m, key[i]);
+  }
+  int min = _mm_extract_epi16(_mm_minpos_epu16(FOLD(m)), 0);
+  if (min == FIXED_KEY)
+    return 0; /* solved */
+
+  lanes target = SET1(min);
+  for (int i = 0; i < NUM_VECTORS; i++) {
+    unsigned mask = MOVEMASK(EQ16(key[i], target));
+    if (mask)
+      return offset[i] + __builtin_ctz(mask) / 2;
+  }
+  return 0; /* not reached */
+}
+
+#undef LANES
+#undef LOAD
+#undef SET1
+#undef AND
+#undef ADD8
+#undef ADD16
+#undef SHR16
+#undef SHUFFLE
+#undef EQ16
+#undef MIN16
+#undef MOVEMASK
+#undef NIBBLE_COUNTS
+#undef FOLD
+
+#else
+
+pos next_move(solver const *s)
+{
+  int p = 0, m = 10, i;
+  for (i = 0; i < SUDOKU_SIZE; i++) {
+    int n = SET_SIZE(s->sudoku.free[i]);
+    if (n == 0) {
+      /*
+       * n == 0 implies that the current puzzle configuration is
+       * unsolveable. Our caller will detect this and backtrack.
+       */
+      p = i;
+      break;
+    }
+    if (n > 1 && n < m) {
+      /*
+       * The primary goal of the surrounding loop is to find
+       * the free position with the fewest degrees of freedom.
+       */
+      m = n;
+      p = i;
+    }
+  }
+  /*
+   * If we never found (n > 1 && n < m) then we may reach this
+   * point with p referring to a position that is fixed (1 degree
+   * of freedom.)  This indicates that the puzzle has been solved.
+   */
+  return p;
+}
+
+#endif
+
+/*
+ * Branching Heuristics
+ * --------------------
+ *
+ * The reference and trail engines branch on the position
+ * choose_move() picks by s->variable:
+ *
+ *   MRV          next_move(): the fewest digits left (the minimum
+ *                remaining values), lowest position first.
+ *   MRV_DEGREE   the fewest digits left, ties going to the position
+ *                with the most open neighbors, where a choice
+ *                constrains the most of the rest of the board.
+ *   MOST_CONSTRAINED_UNIT
+ *                the unit with the fewest open positions, and in it
+ *                the position with the fewest digits left.
+ *
+ * and try its digits in the order order_digits() gives by s->value:
+ * ASCENDING, or LEAST_CONSTRAINING, the digit possible at the fewest
+ * open neighbors first, as choosing it rules out the fewest digits
+ * elsewhere.  The bitboard and dancing links engines keep their own
+ * orders.
+ */
+
+static pos next_move_degree(solver const *s)
+{
+  digit_set const *f = s->sudoku.free;
+  int p = 0, m = NUMBER_OF_DIGITS + 1, degree = -1;
+  for (int i = 0; i < SUDOKU_SIZE; i++) {
+    int n = SET_SIZE(f[i]);
+    if (n == 0)
+      return i;
+    if (n == 1 || n > m)
+      continue;
+    int d = 0;
+    for (int k = 0; k < NUM_NEIGHBORS; k++)
+      d += SET_SIZE(f[neighbors[i][k]]) > 1;
+    if (n < m || d > degree) {
+      m = n;
+      p = i;
+      degree = d;
+    }
+  }
+  return p;
+}
+
+static pos next_move_unit(solver const *s)
+{
+  digit_set const *f = s->sudoku.free;
+  int best = -1, fewest = UNIT_SIZE + 1;
+  for (int i = 0; i < SUDOKU_SIZE; i++)
+    if (f[i] == 0)
+      return i;
+  for (int u = 0; u < NUM_UNITS; u++) {
+    int open = 0;
+    for (int i = 0; i < UNIT_SIZE; i++)
+      open += SET_SIZE(f[units[u][i]]) > 1;
+    if (open > 0 && open < fewest) {
+      fewest = open;
+      best = u;
+    }
+  }
+  if (best < 0)
+    return 0; /* solved */
+  pos p = 0;
+  int m = NUMBER_OF_DIGITS + 1;
+  for (int i = 0; i < UNIT_SIZE; i++) {
+    int n = SET_SIZE(f[units[best][i]]);
+    if (n > 1 && n < m) {
+      m = n;
+      p = units[best][i];
+    }
+  }
+  return p;
+}
+
+pos choose_move(solver const *s)
+{
+  switch (s->variable) {
+  case MRV_DEGREE:
+    return next_move_degree(s);
+  case MOST_CONSTRAINED_UNIT:
+    return next_move_unit(s);
+  default:
+    return next_move(s);
+  }
+}
+
+/*
+ * Write the digits of dsp, the digits possible at p, into order in
+ * the order to try them.  Returns how many there are.
+ */
+int order_digits(solver const *s, pos p, digit_set dsp, digit *order)
+{
+  int n = 0;
+  for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++)
+    if (IN_SET(dsp, d))
+      order[n++] = d;
+  if (s->value != LEAST_CONSTRAINING)
+    return n;
+
+  int cost[MAX_DIGIT + 1] = { 0 };
+  for (int k = 0; k < NUM_NEIGHBORS; k++) {
+    digit_set f = s->sudoku.free[neighbors[p][k]];
+    if (SET_SIZE(f) > 1)
+      for (int i = 0; i < n; i++)
+        cost[order[i]] += IN_SET(f, order[i]);
+  }
+  /* insertion sort, stable so that ties stay ascending */
+  for (int i = 1; i < n; i++) {
+    digit d = order[i];
+    int j = i;
+    for (; j > 0 && cost[order[j - 1]] > cost[d]; j--)
+      order[j] = order[j - 1];
+    order[j] = d;
+  }
+  return n;
+}
+
+static inline bool room_for_solution(solver const *s)
+{
+  return sudoku_stack_length(s->solutions) < sudoku_stack_capacity(s->solutions);
+}
+
+/*
+ * Count a solution found at a leaf of the search.  Returns true if
+ * the search should stop.
+ */
+static inline bool solution_found(solver *s)
+{
+  return ++s->count.found == s->limit;
+}
+
+/*
+ * Budgets
+ * -------
+ *
+ * One pathological puzzle can keep a search busy for as long as it
+ * takes, and everything queued behind it waits.  A solver may be
+ * given a budget per puzzle: at most max_choices choices, and at
+ * most time_limit nanoseconds from clear_counts().  Every engine asks
+ * give_up() before each choice; over budget, it sets count.aborted
+ * and the search unwinds as if cancelled.  The clock is read only
+ * every CLOCK_INTERVAL choices, so a time limit costs next to
+ * nothing and is overshot by at most that many choices.
+ */
+
+#define CLOCK_INTERVAL 256
+
+static inline uint64_t monotonic_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static inline bool give_up(solver *s)
+{
+  if (s->cancel && __atomic_load_n(s->cancel, __ATOMIC_RELAXED))
+    return true;
+  if (s->count.choice < s->max_choices &&
+      (s->deadline == 0 || s->count.choice % CLOCK_INTERVAL != 0 ||
+       monotonic_ns() < s->deadline))
+    return false;
+  s->count.aborted = true;
+  return true;
+}
+
+bool solve(solver *s)
+{
+  if (give_up(s))
+    return true;
+
+  s->count.choice++;
+  STAT_CLOCK(t);
+  bool ok = propagate(&s->sudoku, s->level, NULL);
+  STAT_SPLIT(t, propagate_ticks);
+  if (!ok)
+    return false;
+
+  pos p = choose_move(s);
+  STAT_SPLIT(t, next_move_ticks);
+
+  digit_set dsp = s->sudoku.free[p];
+  int n = SET_SIZE(dsp);
+  if (n == 0)
+    return false;
+
+  if (n == 1) {
+    if (room_for_solution(s))
+      sudoku_stack_push(s->solutions, &s->sudoku);
+    return solution_found(s);
+  }
+
+  digit order[NUMBER_OF_DIGITS];
+  order_digits(s, p, dsp, order);
+  sudoku r = s->sudoku;
+  STAT_SPLIT(t, copy_ticks);
+  STAT_PUSH();
+  for (int i = 0; i < n; i++) {
+    STAT_CLOCK(u);
+    ok = claim(&s->sudoku, p, order[i], NULL);
+    STAT_SPLIT(u, propagate_ticks);
+    if (ok && solve(s))
+      return true;
+    s->count.backtrack++;
+    STAT_CLOCK(v);
+    s->sudoku = r;
+    STAT_SPLIT(v, copy_ticks);
+  }
+  STAT_POP();
+  /*
+   * Any solutions found in this subtree are in s->solutions, but
+   * we've not yet found as many as we were asked for, so the search
+   * must go on in the remaining subtrees.
+   */
+  return false;
+}
+
+/*
+ * The same search as solve(), but undoing each choice by rewinding
+ * the trail rather than restoring a copy of the whole sudoku.  Which
+ * is faster depends on how many positions a typical choice changes.
+ */
+static bool solve_trail_from(solver *s)
+{
+  if (give_up(s))
+    return true;
+
+  s->count.choice++;
+  STAT_CLOCK(t);
+  bool ok = propagate(&s->sudoku, s->level, &s->trail);
+  STAT_SPLIT(t, propagate_ticks);
+  if (!ok)
+    return false;
+
+  pos p = choose_move(s);
+  STAT_SPLIT(t, next_move_ticks);
+
+  digit_set dsp = s->sudoku.free[p];
+  int n = SET_SIZE(dsp);
+  if (n == 0)
+    return false;
+
+  if (n == 1) {
+    if (room_for_solution(s))
+      sudoku_stack_push(s->solutions, &s->sudoku);
+    return solution_found(s);
+  }
+
+  digit order[NUMBER_OF_DIGITS];
+  order_digits(s, p, dsp, order);
+  trail_entry *mark = s->trail.top;
+  STAT_PUSH();
+  for (int i = 0; i < n; i++) {
+    STAT_CLOCK(u);
+    ok = claim(&s->sudoku, p, order[i], &s->trail);
+    STAT_SPLIT(u, propagate_ticks);
+    if (ok && solve_trail_from(s))
+      return true;
+    s->count.backtrack++;
+    STAT_CLOCK(v);
+    undo(&s->sudoku, &s->trail, mark);
+    STAT_SPLIT(v, copy_ticks);
+  }
+  STAT_POP();
+  return false;
+}
+
+bool solve_trail(solver *s)
+{
+  s->trail.top = s->trail.entry;
+  return solve_trail_from(s);
+}
+
+solver *clear_counts(solver *v)
+{
+  v->count.backtrack = 0;
+  v->count.choice = 0;
+  v->count.found = 0;
+  v->count.aborted = false;
+  v->deadline = v->time_limit ? monotonic_ns() + v->time_limit : 0;
+  return v;
+}  
+
+/*
+ * Bitboard Engine
+ * ===============
+ *
+ * The bitboard engine keeps the board digit major: for each digit a
+ * plane of 81 bits marks the positions where that digit is still
+ * possible.  Each plane is split into three bands of 27 bits, one
+ * per row of boxes, so that bit i of band k stands for position
+ * 27 * k + i.  A row or a box then lies within a single band and a
+ * column takes the same three bits of every band.
+ *
+ * Placing a digit clears the position from every other plane and
+ * clears the position's neighbors from the digit's own plane, which
+ * takes a handful of mask operations instead of a walk over the
+ * neighbors table.
+ *
+ * The engine propagates to the same fixpoint as claim(), revoke()
+ * and propagate() and chooses positions and digits in the same
+ * order as solve(), so both engines visit the same search tree and
+ * produce the same output.
+ */
+
+typedef unsigned int band;
+
+#define BAND_BITS 27
+#define BAND_MASK ((band)0x7FFFFFF)
+#define BAND_OF(p) ((p) / BAND_BITS)
+#define BIT_OF(p)  ((band)1 << ((p) % BAND_BITS))
+
+typedef struct {
+  band digit[NUMBER_OF_DIGITS][3]; /* plane per digit, indexed d - MIN_DIGIT */
+  band open[3];                    /* positions not yet fixed */
+} bitboard;
+
+/*
+ * The neighbors and units of each position as band masks. Generated
+ * from the neighbors and units tables above.
+ */
+static const band bb_peers[SUDOKU_SIZE][3] = {
+    {0x01C0FFE, 0x0040201, 0x0040201},
+    {0x01C0FFD, 0x0080402, 0x0080402},
+    {0x01C0FFB, 0x0100804, 0x0100804},
+    {0x0E071F7, 0x0201008, 0x0201008},
+    {0x0E071EF, 0x0402010, 0x0402010},
+    {0x0E071DF, 0x0804020, 0x0804020},
+    {0x70381BF, 0x1008040, 0x1008040},
+    {0x703817F, 0x2010080, 0x2010080},
+    {0x70380FF, 0x4020100, 0x4020100},
+    {0x01FFC07, 0x0040201, 0x0040201},
+    {0x01FFA07, 0x0080402, 0x0080402},
+    {0x01FF607, 0x0100804, 0x0100804},
+    {0x0E3EE38, 0x0201008, 0x0201008},
+    {0x0E3DE38, 0x0402010, 0x0402010},
+    {0x0E3BE38, 0x0804020, 0x0804020},
+    {0x7037FC0, 0x1008040, 0x1008040},
+    {0x702FFC0, 0x2010080, 0x2010080},
+    {0x701FFC0, 0x4020100, 0x4020100},
+    {0x7F80E07, 0x0040201, 0x0040201},
+    {0x7F40E07, 0x0080402, 0x0080402},
+    {0x7EC0E07, 0x0100804, 0x0100804},
+    {0x7DC7038, 0x0201008, 0x0201008},
+    {0x7BC7038, 0x0402010, 0x0402010},
+    {0x77C7038, 0x0804020, 0x0804020},
+    {0x6FF81C0, 0x1008040, 0x1008040},
+    {0x5FF81C0, 0x2010080, 0x2010080},
+    {0x3FF81C0, 0x4020100, 0x4020100},
+    {0x0040201, 0x01C0FFE, 0x0040201},
+    {0x0080402, 0x01C0FFD, 0x0080402},
+    {0x0100804, 0x01C0FFB, 0x0100804},
+    {0x0201008, 0x0E071F7, 0x0201008},
+    {0x0402010, 0x0E071EF, 0x0402010},
+    {0x0804020, 0x0E071DF, 0x0804020},
+    {0x1008040, 0x70381BF, 0x1008040},
+    {0x2010080, 0x703817F, 0x2010080},
+    {0x4020100, 0x70380FF, 0x4020100},
+    {0x0040201, 0x01FFC07, 0x0040201},
+    {0x0080402, 0x01FFA07, 0x0080402},
+    {0x0100804, 0x01FF607, 0x0100804},
+    {0x0201008, 0x0E3EE38, 0x0201008},
+    {0x0402010, 0x0E3DE38, 0x0402010},
+    {0x0804020, 0x0E3BE38, 0x0804020},
+    {0x1008040, 0x7037FC0, 0x1008040},
+    {0x2010080, 0x702FFC0, 0x2010080},
+    {0x4020100, 0x701FFC0, 0x4020100},
+    {0x0040201, 0x7F80E07, 0x0040201},
+    {0x0080402, 0x7F40E07, 0x0080402},
+    {0x0100804, 0x7EC0E07, 0x0100804},
+    {0x0201008, 0x7DC7038, 0x0201008},
+    {0x0402010, 0x7BC7038, 0x0402010},
+    {0x0804020, 0x77C7038, 0x0804020},
+    {0x1008040, 0x6FF81C0, 0x1008040},
+    {0x2010080, 0x5FF81C0, 0x2010080},
+    {0x4020100, 0x3FF81C0, 0x4020100},
+    {0x0040201, 0x0040201, 0x01C0FFE},
+    {0x0080402, 0x0080402, 0x01C0FFD},
+    {0x0100804, 0x0100804, 0x01C0FFB},
+    {0x0201008, 0x0201008, 0x0E071F7},
+    {0x0402010, 0x0402010, 0x0E071EF},
+    {0x0804020, 0x0804020, 0x0E071DF},
+    {0x1008040, 0x1008040, 0x70381BF},
+    {0x2010080, 0x2010080, 0x703817F},
+    {0x4020100, 0x4020100, 0x70380FF},
+    {0x0040201, 0x0040201, 0x01FFC07},
+    {0x0080402, 0x0080402, 0x01FFA07},
+    {0x0100804, 0x0100804, 0x01FF607},
+    {0x0201008, 0x0201008, 0x0E3EE38},
+    {0x0402010, 0x0402010, 0x0E3DE38},
+    {0x0804020, 0x0804020, 0x0E3BE38},
+    {0x1008040, 0x1008040, 0x7037FC0},
+    {0x2010080, 0x2010080, 0x702FFC0},
+    {0x4020100, 0x4020100, 0x701FFC0},
+    {0x0040201, 0x0040201, 0x7F80E07},
+    {0x0080402, 0x0080402, 0x7F40E07},
+    {0x0100804, 0x0100804, 0x7EC0E07},
+    {0x0201008, 0x0201008, 0x7DC7038},
+    {0x0402010, 0x0402010, 0x7BC7038},
+    {0x0804020, 0x0804020, 0x77C7038},
+    {0x1008040, 0x1008040, 0x6FF81C0},
+    {0x2010080, 0x2010080, 0x5FF81C0},
+    {0x4020100, 0x4020100, 0x3FF81C0}
+  };
+
+static const band bb_units[NUM_UNITS][3] = {
+    {0x00001FF, 0x0000000, 0x0000000},
+    {0x003FE00, 0x0000000, 0x0000000},
+    {0x7FC0000, 0x0000000, 0x0000000},
+    {0x0000000, 0x00001FF, 0x0000000},
+    {0x0000000, 0x003FE00, 0x0000000},
+    {0x0000000, 0x7FC0000, 0x0000000},
+    {0x0000000, 0x0000000, 0x00001FF},
+    {0x0000000, 0x0000000, 0x003FE00},
+    {0x0000000, 0x0000000, 0x7FC0000},
+    {0x0040201, 0x0040201, 0x0040201},
+    {0x0080402, 0x0080402, 0x0080402},
+    {0x0100804, 0x0100804, 0x0100804},
+    {0x0201008, 0x0201008, 0x0201008},
+    {0x0402010, 0x0402010, 0x0402010},
+    {0x0804020, 0x0804020, 0x0804020},
+    {0x1008040, 0x1008040, 0x1008040},
+    {0x2010080, 0x2010080, 0x2010080},
+    {0x4020100, 0x4020100, 0x4020100},
+    {0x01C0E07, 0x0000000, 0x0000000},
+    {0x0E07038, 0x0000000, 0x0000000},
+    {0x70381C0, 0x0000000, 0x0000000},
+    {0x0000000, 0x01C0E07, 0x0000000},
+    {0x0000000, 0x0E07038, 0x0000000},
+    {0x0000000, 0x70381C0, 0x0000000},
+    {0x0000000, 0x0000000, 0x01C0E07},
+    {0x0000000, 0x0000000, 0x0E07038},
+    {0x0000000, 0x0000000, 0x70381C0}
+  };
+
+static void bb_place(bitboard *b, pos p, int d)
+{
+  int k = BAND_OF(p);
+  band bit = BIT_OF(p);
+  for (int e = 0; e < NUMBER_OF_DIGITS; e++)
+    b->digit[e][k] &= ~bit;
+  for (int j = 0; j < 3; j++)
+    b->digit[d][j] &= ~bb_peers[p][j];
+  b->digit[d][k] |= bit;
+  b->open[k] &= ~bit;
+}
+
+static inline int bb_count(band const *x)
+{
+  return __builtin_popcount(x[0]) + __builtin_popcount(x[1])
+    + __builtin_popcount(x[2]);
+}
+
+static inline pos bb_first(band const *x)
+{
+  for (int k = 0; k < 3; k++)
+    if (x[k])
+      return k * BAND_BITS + __builtin_ctz(x[k]);
+  return SUDOKU_SIZE;
+}
+
+/*
+ * Fix every open position that has only one digit left.  Returns
+ * false if some position has no digit left at all.
+ */
+static bool bb_naked_singles(bitboard *b, bool *changed)
+{
+  for (int k = 0; k < 3; k++) {
+    band once = 0, twice = 0;
+    for (int d = 0; d < NUMBER_OF_DIGITS; d++) {
+      twice |= once & b->digit[d][k];
+      once |= b->digit[d][k];
+    }
+    if (once != BAND_MASK)
+      return false;
+    band singles = once & ~twice & b->open[k];
+    while (singles) {
+      int i = __builtin_ctz(singles);
+      singles &= singles - 1;
+      int d = 0;
+      while (d < NUMBER_OF_DIGITS && !(b->digit[d][k] & ((band)1 << i)))
+        d++;
+      if (d == NUMBER_OF_DIGITS)
+        return false; /* emptied by one of the singles just placed */
+      bb_place(b, k * BAND_BITS + i, d);
+      *changed = true;
+    }
+  }
+  return true;
+}
+
+#define ROW_MASK ((band)0x00001FF) /* first row of a band */
+#define BOX_MASK ((band)0x01C0E07) /* first box of a band */
+
+static bool bb_hidden_single(bitboard *b, int d, int k, band y, bool *changed)
+{
+  if (y == 0)
+    return false;
+  if ((y & (y - 1)) == 0 && (b->open[k] & y)) {
+    bb_place(b, k * BAND_BITS + __builtin_ctz(y), d);
+    *changed = true;
+  }
+  return true;
+}
+
+static bool bb_hidden_singles(bitboard *b, bool *changed)
+{
+  for (int d = 0; d < NUMBER_OF_DIGITS; d++) {
+    band *x = b->digit[d];
+
+    /* rows and boxes each lie within one band */
+    for (int k = 0; k < 3; k++) {
+      for (int i = 0; i < 3; i++) {
+        if (!bb_hidden_single(b, d, k, x[k] & (ROW_MASK << (9 * i)), changed))
+          return false;
+        if (!bb_hidden_single(b, d, k, x[k] & (BOX_MASK << (3 * i)), changed))
+          return false;
+      }
+    }
+
+    /*
+     * Fold the nine rows onto one, counting to two: bit c of once
+     * (twice) is set if the digit is possible at least once (twice)
+     * in column c.
+     */
+    band once = 0, twice = 0;
+    for (int k = 0; k < 3; k++) {
+      for (int i = 0; i < 3; i++) {
+        band y = (x[k] >> (9 * i)) & ROW_MASK;
+        twice |= once & y;
+        once |= y;
+      }
+    }
+    if (once != ROW_MASK)
+      return false;
+    for (band single = once & ~twice; single; single &= single - 1) {
+      int c = __builtin_ctz(single);
+      pos q = SUDOKU_SIZE;
+      for (int k = 0; k < 3 && q == SUDOKU_SIZE; k++)
+        for (int i = 0; i < 3 && q == SUDOKU_SIZE; i++)
+          if (x[k] & ((band)1 << (9 * i + c)))
+            q = k * BAND_BITS + 9 * i + c;
+      if (q == SUDOKU_SIZE)
+        return false; /* emptied by one of the singles just placed */
+      if (b->open[BAND_OF(q)] & BIT_OF(q)) {
+        bb_place(b, q, d);
+        *changed = true;
+      }
+    }
+  }
+  return true;
+}
+
+static void bb_locked_candidates(bitboard *b, bool *changed)
+{
+  for (int bx = 0; bx < 9; bx++) {
+    band const *box = bb_units[BOX_UNIT(bx)];
+    for (int k = 0; k < 6; k++) {
+      int l = (k < 3) ? ROW_UNIT(bx / 3 * 3 + k) : COL_UNIT(bx % 3 * 3 + k - 3);
+      band const *line = bb_units[l];
+      for (int d = 0; d < NUMBER_OF_DIGITS; d++) {
+        band *x = b->digit[d];
+        band cross = 0, box_rest = 0, line_rest = 0;
+        for (int j = 0; j < 3; j++) {
+          cross |= x[j] & box[j] & line[j];
+          box_rest |= x[j] & box[j] & ~line[j];
+          line_rest |= x[j] & line[j] & ~box[j];
+        }
+        if (!cross || (box_rest && line_rest))
+          continue;
+        if (!box_rest && line_rest) {
+          for (int j = 0; j < 3; j++)
+            x[j] &= ~(line[j] & ~box[j]);
+          *changed = true;
+        } else if (!line_rest && box_rest) {
+          for (int j = 0; j < 3; j++)
+            x[j] &= ~(box[j] & ~line[j]);
+          *changed = true;
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Place d at p and propagate naked singles, the equivalent of claim().
+ */
+static bool bb_claim(bitboard *b, pos p, int d)
+{
+  bool changed;
+  bb_place(b, p, d);
+  do {
+    changed = false;
+    if (!bb_naked_singles(b, &changed))
+      return false;
+  } while (changed);
+  return true;
+}
+
+static bool bb_propagate(bitboard *b, propagation level)
+{
+  bool changed;
+  do {
+    changed = false;
+    if (!bb_naked_singles(b, &changed))
+      return false;
+    if (!changed && level >= HIDDEN_SINGLES && !bb_hidden_singles(b, &changed))
+      return false;
+    if (!changed && level >= LOCKED_CANDIDATES)
+      bb_locked_candidates(b, &changed);
+  } while (changed);
+  return true;
+}
+
+/*
+ * The open position with the fewest digits left, lowest position
+ * first, just like next_move().  The number of digits possible at
+ * each position is summed over the planes bit-sliced: afterwards bit
+ * i of c[k][j] is bit j of the count at position 27 * k + i.
+ */
+static pos bb_next_move(bitboard const *b)
+{
+  band c[3][4] = { { 0 } };
+  for (int k = 0; k < 3; k++) {
+    for (int d = 0; d < NUMBER_OF_DIGITS; d++) {
+      band carry = b->digit[d][k];
+      for (int j = 0; j < 4 && carry; j++) {
+        band t = c[k][j] & carry;
+        c[k][j] ^= carry;
+        carry = t;
+      }
+    }
+  }
+  for (int n = 2; n <= NUMBER_OF_DIGITS; n++) {
+    band m[3];
+    for (int k = 0; k < 3; k++) {
+      m[k] = b->open[k];
+      for (int j = 0; j < 4; j++)
+        m[k] &= (n >> j & 1) ? c[k][j] : ~c[k][j];
+    }
+    pos p = bb_first(m);
+    if (p < SUDOKU_SIZE)
+      return p;
+  }
+  return SUDOKU_SIZE;
+}
+
+static void bb_to_sudoku(bitboard const *b, sudoku *s)
+{
+  for (pos p = 0; p < SUDOKU_SIZE; p++) {
+    s->free[p] = NO_DIGITS;
+    for (int d = 0; d < NUMBER_OF_DIGITS; d++)
+      if (b->digit[d][BAND_OF(p)] & BIT_OF(p))
+        s->free[p] |= SET_OF(MIN_DIGIT + d);
+  }
+}
+
+static void bb_from_sudoku(bitboard *b, sudoku const *s)
+{
+  for (int k = 0; k < 3; k++) {
+    b->open[k] = 0;
+    for (int d = 0; d < NUMBER_OF_DIGITS; d++)
+      b->digit[d][k] = 0;
+  }
+  for (pos p = 0; p < SUDOKU_SIZE; p++) {
+    for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++)
+      if (IN_SET(s->free[p], d))
+        b->digit[d - MIN_DIGIT][BAND_OF(p)] |= BIT_OF(p);
+    if (SET_SIZE(s->free[p]) > 1)
+      b->open[BAND_OF(p)] |= BIT_OF(p);
+  }
+}
+
+static bool bb_solve(solver *s, bitboard *b)
+{
+  if (give_up(s))
+    return true;
+
+  s->count.choice++;
+  if (!bb_propagate(b, s->level))
+    return false;
+
+  if (!(b->open[0] | b->open[1] | b->open[2])) {
+    if (room_for_solution(s))
+      bb_to_sudoku(b, sudoku_stack_emplace(s->solutions));
+    return solution_found(s);
+  }
+
+  pos p = bb_next_move(b);
+  if (p == SUDOKU_SIZE)
+    return false; /* can't happen: propagation leaves no singles open */
+  for (int d = 0; d < NUMBER_OF_DIGITS; d++) {
+    if (b->digit[d][BAND_OF(p)] & BIT_OF(p)) {
+      bitboard r = *b;
+      if (bb_claim(&r, p, d) && bb_solve(s, &r))
+        return true;
+      s->count.backtrack++;
+    }
+  }
+  return false;
+}
+
+bool solve_bitboard(solver *s)
+{
+  bitboard b;
+  bb_from_sudoku(&b, &s->sudoku);
+  return bb_solve(s, &b);
+}
+
+/*
+ * Dancing Links Engine
+ * ====================
+ *
+ * Sudoku is an exact cover problem.  Each of the 729 placements of a
+ * digit at a position is a row, and each of the 324 constraints is a
+ * column that must be covered exactly once:
+ *
+ *   0 ..  80   position p holds some digit
+ *  81 .. 161   row r holds digit d
+ * 162 .. 242   column c holds digit d
+ * 243 .. 323   box b holds digit d
+ *
+ * Knuth's Algorithm X with dancing links solves it: repeatedly pick
+ * the column with the fewest rows left, and try each of its rows in
+ * turn, covering every column the row satisfies.
+ *
+ * The matrix is a pool of nodes linked by index rather than by
+ * pointer.  Node 0 is the root, nodes 1 .. 324 head the columns and
+ * the rest hold the rows.  The pool is part of the solver's memory
+ * and rebuilt for each puzzle from the possible digits of the
+ * solver's sudoku.  Positions already fixed are chosen up front.
+ *
+ * The exact cover formulation subsumes hidden singles (a column with
+ * a single row left) so the propagation level is not consulted.
+ */
+
+#define DLX_COLUMNS (4 * SUDOKU_SIZE)
+#define DLX_ROWS    (SUDOKU_SIZE * NUMBER_OF_DIGITS)
+#define DLX_NODES   (1 + DLX_COLUMNS + 4 * DLX_ROWS)
+
+typedef unsigned short link;
+
+typedef struct {
+  link l, r, u, d; /* neighbors in the row (l, r) and column (u, d) */
+  link c;          /* column header */
+  short row;       /* p * NUMBER_OF_DIGITS + d - MIN_DIGIT, -1 in headers */
+} dlx_node;
+
+struct dlx {
+  dlx_node node[DLX_NODES];
+  short size[1 + DLX_COLUMNS]; /* rows left in each column */
+  link chosen[SUDOKU_SIZE];    /* rows chosen on the current path */
+};
+
+typedef struct dlx dlx;
+
+static void dlx_cover(dlx *x, link c)
+{
+  dlx_node *n = x->node;
+  n[n[c].r].l = n[c].l;
+  n[n[c].l].r = n[c].r;
+  for (link i = n[c].d; i != c; i = n[i].d) {
+    for (link j = n[i].r; j != i; j = n[j].r) {
+      n[n[j].d].u = n[j].u;
+      n[n[j].u].d = n[j].d;
+      x->size[n[j].c]--;
+    }
+  }
+}
+
+static void dlx_uncover(dlx *x, link c)
+{
+  dlx_node *n = x->node;
+  for (link i = n[c].u; i != c; i = n[i].u) {
+    for (link j = n[i].l; j != i; j = n[j].l) {
+      x->size[n[j].c]++;
+      n[n[j].d].u = j;
+      n[n[j].u].d = j;
+    }
+  }
+  n[n[c].r].l = c;
+  n[n[c].l].r = c;
+}
+
+/*
+ * Build the matrix for s. Returns false if some position has no
+ * digit left, in which case the matrix is not usable.
+ */
+static bool dlx_load(dlx *x, sudoku const *s)
+{
+  dlx_node *n = x->node;
+  link fixed[SUDOKU_SIZE];
+  int nfixed = 0;
+
+  for (link c = 0; c <= DLX_COLUMNS; c++) {
+    n[c].l = (c == 0) ? DLX_COLUMNS : c - 1;
+    n[c].r = (c == DLX_COLUMNS) ? 0 : c + 1;
+    n[c].u = n[c].d = n[c].c = c;
+    n[c].row = -1;
+    x->size[c] = 0;
+  }
+
+  link next = DLX_COLUMNS + 1;
+  for (pos p = 0; p < SUDOKU_SIZE; p++) {
+    if (s->free[p] == NO_DIGITS)
+      return false;
+    for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++) {
+      if (!IN_SET(s->free[p], d))
+        continue;
+      int i = d - MIN_DIGIT;
+      link cols[4] = {
+        1 + p,
+        1 + SUDOKU_SIZE + ROW_OF(p) * NUMBER_OF_DIGITS + i,
+        1 + 2 * SUDOKU_SIZE + COL_OF(p) * NUMBER_OF_DIGITS + i,
+        1 + 3 * SUDOKU_SIZE + BOX_OF(p) * NUMBER_OF_DIGITS + i
+      };
+      if (SET_SIZE(s->free[p]) == 1)
+        fixed[nfixed++] = next;
+      for (int k = 0; k < 4; k++) {
+        link j = next + k, c = cols[k];
+        n[j].c = c;
+        n[j].row = p * NUMBER_OF_DIGITS + i;
+        n[j].l = next + (k + 3) % 4;
+        n[j].r = next + (k + 1) % 4;
+        n[j].u = n[c].u;
+        n[j].d = c;
+        n[n[c].u].d = j;
+        n[c].u = j;
+        x->size[c]++;
+      }
+      next += 4;
+    }
+  }
+
+  for (int i = 0; i < nfixed; i++) {
+    link r = fixed[i];
+    dlx_cover(x, n[r].c);
+    for (link j = n[r].r; j != r; j = n[j].r)
+      dlx_cover(x, n[j].c);
+  }
+  return true;
+}
+
+static bool dlx_search(solver *s, dlx *x, int k)
+{
+  if (give_up(s))
+    return true;
+
+  dlx_node *n = x->node;
+  s->count.choice++;
+
+  if (n[0].r == 0) {
+    if (room_for_solution(s)) {
+      sudoku *solution = sudoku_stack_emplace(s->solutions);
+      *solution = s->sudoku;
+      for (int i = 0; i < k; i++) {
+        int row = n[x->chosen[i]].row;
+        solution->free[row / NUMBER_OF_DIGITS] = SET_OF(MIN_DIGIT + row % NUMBER_OF_DIGITS);
+      }
+    }
+    return solution_found(s);
+  }
+
+  link c = n[0].r;
+  for (link j = n[c].r; j != 0 && x->size[c] > 0; j = n[j].r)
+    if (x->size[j] < x->size[c])
+      c = j;
+  if (x->size[c] == 0)
+    return false;
+
+  dlx_cover(x, c);
+  for (link r = n[c].d; r != c; r = n[r].d) {
+    x->chosen[k] = r;
+    for (link j = n[r].r; j != r; j = n[j].r)
+      dlx_cover(x, n[j].c);
+    if (dlx_search(s, x, k + 1))
+      return true; /* the matrix is rebuilt for the next puzzle */
+    for (link j = n[r].l; j != r; j = n[j].l)
+      dlx_uncover(x, n[j].c);
+    s->count.backtrack++;
+  }
+  dlx_uncover(x, c);
+  return false;
+}
+
+bool solve_dlx(solver *s)
+{
+  if (!dlx_load(s->dlx, &s->sudoku)) {
+    s->count.choice++;
+    return false;
+  }
+  return dlx_search(s, s->dlx, 0);
+}
+
+/*
+ * Grader
+ * ======
+ *
+ * How hard a puzzle is for a person has little to do with how many
+ * choices a search makes, which depends on the order it tries things
+ * in.  With --grade the solver instead works the puzzle the way a
+ * person would, eliminating candidates from the digit sets with the
+ * cheapest technique that still makes progress, and reports the
+ * hardest technique it needed and a score.
+ *
+ * Naked singles come for free with every elimination, as always.  In
+ * increasing cost the techniques are:
+ *
+ *   hidden singles   see Unit Propagation
+ *   naked subsets    2 or 3 positions of a unit that between them
+ *                    allow only 2 or 3 digits, which then can't go
+ *                    anywhere else in the unit
+ *   hidden subsets   2 or 3 digits that between them have only 2 or
+ *                    3 positions in a unit, which then can't hold
+ *                    any other digit
+ *   pointing         locked candidates, see Unit Propagation
+ *   x-wing,          a digit whose positions in 2 (3) rows lie in
+ *   swordfish        only 2 (3) columns can't go anywhere else in
+ *                    those columns, and the same with rows and
+ *                    columns swapped
+ *   xy-wing          a pivot {x,y} seeing pincers {x,z} and {y,z}:
+ *                    one pincer is z, so nothing seeing both is
+ *   xy-chain         the same for any chain of two digit positions
+ *                    each seeing the next and sharing a digit with it
+ *
+ * Each technique sweeps the whole board and the score adds its cost
+ * for every sweep that changed something.  A puzzle that none of the
+ * techniques finish is graded "search".
+ */
+
+typedef enum {
+  NAKED_SINGLE,
+  HIDDEN_SINGLE,
+  NAKED_PAIR,
+  HIDDEN_PAIR,
+  NAKED_TRIPLE,
+  HIDDEN_TRIPLE,
+  POINTING,
+  X_WING,
+  SWORDFISH,
+  XY_WING,
+  XY_CHAIN,
+  SEARCH,
+  INVALID
+} technique;
+
+/* Whether positions p and q are distinct and share a unit. */
+static inline bool sees(pos p, pos q)
+{
+  return p != q &&
+    (ROW_OF(p) == ROW_OF(q) || COL_OF(p) == COL_OF(q) || BOX_OF(p) == BOX_OF(q));
+}
+
+/*
+ * Subsets
+ * -------
+ *
+ * The pairs and triples among n candidates, as k ascending indices
+ * x[0 .. k-1] in lexicographic order:
+ *
+ *   int x[MAX_SUBSET];
+ *   for (bool more = first_subset(x, k, n); more; more = next_subset(x, k, n))
+ */
+
+#define MAX_SUBSET 3
+
+static inline bool first_subset(int *x, int k, int n)
+{
+  for (int j = 0; j < k; j++)
+    x[j] = j;
+  return k <= n;
+}
+
+static inline bool next_subset(int *x, int k, int n)
+{
+  int j = k - 1;
+  while (j >= 0 && x[j] == n - k + j)
+    j--;
+  if (j < 0)
+    return false;
+  x[j]++;
+  for (int i = j + 1; i < k; i++)
+    x[i] = x[i - 1] + 1;
+  return true;
+}
+
+/*
+ * Naked Subsets
+ * -------------
+ */
+
+static bool naked_subsets(sudoku *s, int k, bool *changed)
+{
+  for (int u = 0; u < NUM_UNITS; u++) {
+    pos const *cells = units[u];
+    int c[UNIT_SIZE], n = 0;
+    for (int i = 0; i < UNIT_SIZE; i++) {
+      int size = SET_SIZE(s->free[cells[i]]);
+      if (size >= 2 && size <= k)
+        c[n++] = i;
+    }
+    int x[MAX_SUBSET];
+    for (bool more = first_subset(x, k, n); more; more = next_subset(x, k, n)) {
+      digit_set ds = 0;
+      unsigned in = 0;
+      for (int j = 0; j < k; j++) {
+        ds |= s->free[cells[c[x[j]]]];
+        in |= 1 << c[x[j]];
+      }
+      if (SET_SIZE(ds) != k)
+        continue;
+      for (int i = 0; i < UNIT_SIZE; i++) {
+        pos p = cells[i];
+        if ((in & (1 << i)) || !(s->free[p] & ds))
+          continue;
+        if (!eliminate(s, p, ds, NULL))
+          return false;
+        *changed = true;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Hidden Subsets
+ * --------------
+ */
+
+static bool hidden_subsets(sudoku *s, int k, bool *changed)
+{
+  for (int u = 0; u < NUM_UNITS; u++) {
+    pos const *cells = units[u];
+    unsigned where[MAX_DIGIT + 1] = {0};
+    for (int i = 0; i < UNIT_SIZE; i++)
+      for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++)
+        if (IN_SET(s->free[cells[i]], d))
+          where[d] |= 1 << i;
+    digit c[NUMBER_OF_DIGITS];
+    int n = 0;
+    for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++) {
+      int size = __builtin_popcount(where[d]);
+      if (size >= 2 && size <= k)
+        c[n++] = d;
+    }
+    int x[MAX_SUBSET];
+    for (bool more = first_subset(x, k, n); more; more = next_subset(x, k, n)) {
+      unsigned w = 0;
+      digit_set ds = 0;
+      for (int j = 0; j < k; j++) {
+        w |= where[c[x[j]]];
+        ds |= SET_OF(c[x[j]]);
+      }
+      if (__builtin_popcount(w) != k)
+        continue;
+      for (int i = 0; i < UNIT_SIZE; i++) {
+        pos p = cells[i];
+        if (!(w & (1 << i)) || !(s->free[p] & ~ds))
+          continue;
+        if (!eliminate(s, p, s->free[p] & ~ds, NULL))
+          return false;
+        *changed = true;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Fish
+ * ----
+ *
+ * X-wings (k = 2) and swordfish (k = 3), with rows as the base and
+ * columns as the cover, then the other way round.
+ */
+
+static bool fish(sudoku *s, int k, bool *changed)
+{
+  for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++) {
+    for (int cols = 0; cols < 2; cols++) {
+      unsigned where[UNIT_SIZE];
+      int c[UNIT_SIZE], n = 0;
+      for (int l = 0; l < UNIT_SIZE; l++) {
+        pos const *cells = units[cols ? COL_UNIT(l) : ROW_UNIT(l)];
+        where[l] = 0;
+        for (int i = 0; i < UNIT_SIZE; i++)
+          if (IN_SET(s->free[cells[i]], d))
+            where[l] |= 1 << i;
+        int size = __builtin_popcount(where[l]);
+        if (size >= 2 && size <= k)
+          c[n++] = l;
+      }
+      int x[MAX_SUBSET];
+      for (bool more = first_subset(x, k, n); more; more = next_subset(x, k, n)) {
+        unsigned w = 0, in = 0;
+        for (int j = 0; j < k; j++) {
+          w |= where[c[x[j]]];
+          in |= 1 << c[x[j]];
+        }
+        if (__builtin_popcount(w) != k)
+          continue;
+        for (int l = 0; l < UNIT_SIZE; l++) {
+          if ((in & (1 << l)) || !(where[l] & w))
+            continue;
+          for (int i = 0; i < UNIT_SIZE; i++) {
+            if (!(where[l] & w & (1 << i)))
+              continue;
+            pos p = units[cols ? COL_UNIT(l) : ROW_UNIT(l)][i];
+            if (!eliminate(s, p, SET_OF(d), NULL))
+              return false;
+            *changed = true;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * XY-Wings and XY-Chains
+ * ----------------------
+ *
+ * Both remove z from the positions seeing both ends of a chain of two
+ * digit positions which start and end with z.
+ */
+
+static bool eliminate_seen_by_both(sudoku *s, pos a, pos b, digit z, bool *changed)
+{
+  for (pos p = 0; p < SUDOKU_SIZE; p++) {
+    if (!IN_SET(s->free[p], z) || !sees(p, a) || !sees(p, b))
+      continue;
+    if (!eliminate(s, p, SET_OF(z), NULL))
+      return false;
+    *changed = true;
+  }
+  return true;
+}
+
+static bool xy_wings(sudoku *s, bool *changed)
+{
+  for (pos p = 0; p < SUDOKU_SIZE; p++) {
+    if (SET_SIZE(s->free[p]) != 2)
+      continue;
+    for (int i = 0; i < NUM_NEIGHBORS; i++) {
+      pos a = neighbors[p][i];
+      digit_set fp = s->free[p], fa = s->free[a];
+      if (SET_SIZE(fa) != 2 || SET_SIZE(fa & fp) != 1)
+        continue;
+      digit_set z = fa & ~fp;
+      for (int j = i + 1; j < NUM_NEIGHBORS; j++) {
+        pos b = neighbors[p][j];
+        if (s->free[b] != (z | (fp & ~fa)))
+          continue;
+        if (!eliminate_seen_by_both(s, a, b, __builtin_ctz(z), changed))
+          return false;
+        if (s->free[p] != fp || s->free[a] != fa)
+          break;
+      }
+    }
+  }
+  return true;
+}
+
+static bool xy_chains(sudoku *s, bool *changed)
+{
+  for (pos start = 0; start < SUDOKU_SIZE; start++) {
+    digit_set fs = s->free[start];
+    if (SET_SIZE(fs) != 2)
+      continue;
+    for (digit z = MIN_DIGIT; z <= MAX_DIGIT; z++) {
+      if (!IN_SET(fs, z))
+        continue;
+      /*
+       * Breadth first over (position, digit it must hold if start
+       * isn't z), starting with start holding its other digit.
+       */
+      bool seen[SUDOKU_SIZE][MAX_DIGIT + 1] = {{false}};
+      pos queue_pos[SUDOKU_SIZE * NUMBER_OF_DIGITS];
+      digit queue_digit[SUDOKU_SIZE * NUMBER_OF_DIGITS];
+      int head = 0, tail = 0;
+      digit other = __builtin_ctz(fs & ~SET_OF(z));
+      seen[start][other] = true;
+      queue_pos[tail] = start;
+      queue_digit[tail++] = other;
+      while (head < tail) {
+        pos p = queue_pos[head];
+        digit x = queue_digit[head++];
+        for (int i = 0; i < NUM_NEIGHBORS; i++) {
+          pos q = neighbors[p][i];
+          digit_set fq = s->free[q];
+          if (SET_SIZE(fq) != 2 || !IN_SET(fq, x))
+            continue;
+          digit y = __builtin_ctz(fq & ~SET_OF(x));
+          if (seen[q][y])
+            continue;
+          seen[q][y] = true;
+          if (y == z && q != start) {
+            if (!eliminate_seen_by_both(s, start, q, z, changed))
+              return false;
+            if (s->free[start] != fs)
+              goto next_start;
+          }
+          queue_pos[tail] = q;
+          queue_digit[tail++] = y;
+        }
+      }
+    }
+  next_start:
+    ;
+  }
+  return true;
+}
+
+/*
+ * Grading
+ * -------
+ */
+
+static const struct {
+  char const *name;
+  int cost;
+} techniques[] = {
+  [NAKED_SINGLE]  = { "naked-single",  0 },
+  [HIDDEN_SINGLE] = { "hidden-single", 1 },
+  [NAKED_PAIR]    = { "naked-pair",    3 },
+  [HIDDEN_PAIR]   = { "hidden-pair",   4 },
+  [NAKED_TRIPLE]  = { "naked-triple",  5 },
+  [HIDDEN_TRIPLE] = { "hidden-triple", 6 },
+  [POINTING]      = { "pointing",      8 },
+  [X_WING]        = { "x-wing",        12 },
+  [SWORDFISH]     = { "swordfish",     20 },
+  [XY_WING]       = { "xy-wing",       25 },
+  [XY_CHAIN]      = { "xy-chain",      40 },
+  [SEARCH]        = { "search",        100 },
+  [INVALID]       = { "invalid",       0 },
+};
+
+char const *technique_name(int t)
+{
+  return techniques[t].name;
+}
+
+static bool apply(sudoku *s, technique t, bool *changed)
+{
+  switch (t) {
+  case HIDDEN_SINGLE: return hidden_singles(s, changed, NULL);
+  case NAKED_PAIR:    return naked_subsets(s, 2, changed);
+  case HIDDEN_PAIR:   return hidden_subsets(s, 2, changed);
+  case NAKED_TRIPLE:  return naked_subsets(s, 3, changed);
+  case HIDDEN_TRIPLE: return hidden_subsets(s, 3, changed);
+  case POINTING:      return locked_candidates(s, changed, NULL);
+  case X_WING:        return fish(s, 2, changed);
+  case SWORDFISH:     return fish(s, 3, changed);
+  case XY_WING:       return xy_wings(s, changed);
+  case XY_CHAIN:      return xy_chains(s, changed);
+  default:            return true;
+  }
+}
+
+static bool solved(sudoku const *s)
+{
+  for (int i = 0; i < SUDOKU_SIZE; i++)
+    if (SET_SIZE(s->free[i]) != 1)
+      return false;
+  return true;
+}
+
+/*
+ * The grading engine: grades the solver's sudoku into s->grade.
+ * Finds no solutions.
+ */
+bool grade(solver *v)
+{
+  sudoku *s = &v->sudoku;
+  v->grade.hardest = NAKED_SINGLE;
+  v->grade.score = 0;
+  for (int i = 0; i < SUDOKU_SIZE; i++)
+    if (s->free[i] == NO_DIGITS)
+      goto invalid;
+
+  while (!solved(s)) {
+    technique t;
+    bool changed = false;
+    for (t = HIDDEN_SINGLE; t < SEARCH && !changed; t++)
+      if (!apply(s, t, &changed))
+        goto invalid;
+    if (!changed) {
+      v->grade.hardest = SEARCH;
+      v->grade.score += techniques[SEARCH].cost;
+      return true;
+    }
+    t--;
+    v->count.choice++;
+    v->grade.score += techniques[t].cost;
+    if (t > v->grade.hardest)
+      v->grade.hardest = t;
+  }
+  return true;
+
+invalid:
+  v->grade.hardest = INVALID;
+  return false;
+}
+
+/*
+ * Textual Sudoku Board
+ * ====================
+ *
+ * The textual sudoku board is a string of 81 chars. Fixed
+ * positions are marked by the characters '1' though '9'. 
+ * Open positions (to be solved for) may be marked by
+ * any character, though '.' is used by convention.
+ */
+
+/*
+ * Copy a textual representation of the sudoku s to the string pointed
+ * to be t, which must point to at least SUDOKU_SIZE+1 bytes of
+ * storage.
+ */
+/*
+ * The character for each digit set: '#' for the empty set, the digit
+ * for a single digit and '.' for anything else.
+ */
+static const char cell_char[1024] =
+  "#.1.2...3.......4...............5..............................."
+  "6..............................................................."
+  "7..............................................................."
+  "................................................................"
+  "8..............................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "9..............................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................";
+
+void sudoku_to_text(sudoku const *s, char *t) 
+{
+  for (int i = 0; i < SUDOKU_SIZE; i++)
+    t[i] = cell_char[s->free[i]];
+  t[SUDOKU_SIZE] = '\0';
+}
+
+/*
+ * Parse the first n characters of t (at most SUDOKU_SIZE of them).
+ * Positions beyond n are open.
+ */
+void sudoku_from_text(sudoku *s, char const *t, size_t n)
+{
+  for (int i = 0; i < SUDOKU_SIZE; i++)
+    s->free[i] = ALL_DIGITS;
+
+  for (int i = 0; i < SUDOKU_SIZE && i < n; i++) {
+    char c = t[i];
+    if ('1' <= c && c <= '9') {
+      digit d = CHAR_TO_DIGIT(c);
+      if (!IN_SET(s->free[i], d) || !claim(s, i, d, NULL)) {
+        /* the givens contradict each other */
+        s->free[i] = NO_DIGITS;
+        return;
+      }
+    }
+  }
+}
+
+/*
+ * Solver Memory
+ * =============
+ *
+ * A solver is one block of memory: the solver itself, the dancing
+ * links pool if it uses that engine, and its solutions stack, each
+ * part aligned as malloc() aligns.  Nothing the engines do allocates,
+ * so once the block is set up, solving allocates nothing either.
+ */
+
+/* What malloc() guarantees, and more than any part needs. */
+#define SOLVER_ALIGN (2 * sizeof(size_t))
+#define ALIGN_UP(n)  (((n) + SOLVER_ALIGN - 1) & ~(SOLVER_ALIGN - 1))
+
+size_t solver_bytes(options const *o)
+{
+  size_t n = ALIGN_UP(sizeof(solver));
+  if (o->engine == solve_dlx)
+    n += ALIGN_UP(sizeof(dlx));
+  return n + sudoku_stack_bytes(o->max_sols);
+}
+
+/*
+ * Set up a solver for o in the solver_bytes(o) bytes at mem.
+ */
+solver *init_solver(void *mem, options const *o)
+{
+  solver *v = mem;
+  char *next = (char *)mem + ALIGN_UP(sizeof(solver));
+  memset(v, 0, sizeof(solver));
+  if (o->engine == solve_dlx) {
+    v->dlx = (dlx *)next;
+    next += ALIGN_UP(sizeof(dlx));
+  }
+  v->solutions = sudoku_stack_init(next, o->max_sols);
+  v->level = o->level;
+  v->engine = o->engine;
+  v->variable = o->variable;
+  v->value = o->value;
+  v->limit = o->limit;
+  v->max_choices = o->max_choices ? o->max_choices : INT_MAX;
+  v->time_limit = o->time_limit;
+  v->cache = o->cache;
+  return v;
+}
+
+solver *new_solver(options const *o)
+{
+  return init_solver(malloc(solver_bytes(o)), o);
+}
+
+solver *free_solver(solver *v)
+{
+  free(v);
+  return NULL;
+}
+
+/*
+ * Library Interface
+ * =================
+ *
+ * See sudoku.h.  A config translates to options that keep the first
+ * solution and stop at max_solutions.
+ */
+
+static const engine library_engines[] = {
+  [SUDOKU_REFERENCE] = solve,
+  [SUDOKU_TRAIL]     = solve_trail,
+  [SUDOKU_BITBOARD]  = solve_bitboard,
+  [SUDOKU_DLX]       = solve_dlx,
+};
+
+static bool config_options(sudoku_config const *c, options *o)
+{
+  if (c->engine < SUDOKU_REFERENCE || c->engine > SUDOKU_DLX ||
+      c->level < NAKED_SINGLES || c->level > LOCKED_CANDIDATES ||
+      c->max_solutions < 1 || c->max_choices < 0 || c->timeout_ms < 0)
+    return false;
+  memset(o, 0, sizeof(options));
+  o->max_sols = 1;
+  o->limit = c->max_solutions;
+  o->level = c->level;
+  o->engine = library_engines[c->engine];
+  o->max_choices = c->max_choices;
+  o->time_limit = c->timeout_ms * 1000000ull;
+  return true;
+}
+
+size_t solver_size(sudoku_config const *c)
+{
+  options o;
+  return config_options(c, &o) ? solver_bytes(&o) : 0;
+}
+
+sudoku_solver *solver_init(void *buf, size_t size, sudoku_config const *c)
+{
+  options o;
+  if (!buf || (uintptr_t)buf % SOLVER_ALIGN != 0 ||
+      !config_options(c, &o) || size < solver_bytes(&o))
+    return NULL;
+  return init_solver(buf, &o);
+}
+
+size_t solve_batch(sudoku_solver *v, char const *puzzles, size_t n,
+                   sudoku_result *results)
+{
+  size_t solved = 0;
+  for (size_t i = 0; i < n; i++) {
+    sudoku_result *r = &results[i];
+    sudoku_from_text(&v->sudoku, puzzles + i * SUDOKU_CELLS, SUDOKU_CELLS);
+    clear_counts(v);
+    v->engine(v);
+    r->solutions = v->count.found;
+    r->choices = v->count.choice;
+    r->backtracks = v->count.backtrack;
+    r->aborted = v->count.aborted;
+    if (sudoku_stack_length(v->solutions) > 0) {
+      char text[SUDOKU_SIZE + 1];
+      sudoku_to_text(sudoku_stack_pop(v->solutions), text);
+      memcpy(r->solution, text, SUDOKU_CELLS);
+      solved++;
+    } else {
+      memset(r->solution, '.', SUDOKU_CELLS);
+    }
+  }
+  return solved;
+}
@@ -1,536 +1,2725 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
-#include "array.h"
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <inttypes.h>
+#include "solver.h"
+#include "packed.h"
+#include "board.h"
+#include "counters.h"
+#include "server.h"
+#include "verify.h"
+#include "lockstep.h"
 
 /*
- * Basic Types
- * ===========
- * 
- * In C, the char is always an octet (a byte), but I prefer to call them
- * 'byte' when I mean a non-negative number in the range [0..255].
+ * Input/Output
+ * ============
+ *
+ * We need to be able to read puzzles from stdin and write
+ * their solutions and other ancilliary information to stdout.
  */
 
-typedef unsigned char byte;
-
 /*
- * Digits
- * ======
+ * Reader
+ * ------
  *
- * A solved sudoku consists of a 9x9 grid of digits. Each such digit
- * is an integer between 1 and 9, so we define digit as an alias for byte.
+ * The reader knows how to read sudokus from stdin (or a named file),
+ * one per line.  A line ends at '\n', optionally preceded by '\r'.
+ * The line without its end, cut off at r->cells characters (the
+ * SUDOKU_SIZE of a 9x9 board unless set otherwise), is
+ * the puzzle's text.
+ *
+ * When the input is a regular file the reader maps it into memory
+ * and hands out lines straight from the mapping, without copying
+ * them or making a system call per line.  Pipes and terminals can't
+ * be mapped, so for those the reader falls back to getline().
+ *
+ * Input that starts with the packed puzzle magic is read as packed
+ * puzzles (see packed.c) instead of lines, each unpacked into text.
  */
 
-typedef byte digit;
+typedef struct { 
+  FILE *stream;
+  char *buf;           /* getline()'s buffer */
+  size_t len;
+  char const *map;     /* the mapped input, or NULL if streaming */
+  size_t map_len;
+  size_t offset;       /* start of the next line in map */
+  char const *line;    /* the current line, not terminated */
+  size_t line_len;
+  size_t cells;         /* the longest puzzle text */
+  bool packed;         /* reading packed puzzles */
+  char text[SUDOKU_SIZE]; /* the current packed puzzle, unpacked */
+} reader;
 
-#define MIN_DIGIT        ((digit)1)
-#define MAX_DIGIT        ((digit)9)
-#define NUMBER_OF_DIGITS (MAX_DIGIT - MIN_DIGIT + 1)
+void free_reader(reader *r)
+{
+  if (r->map)
+    munmap((void *)r->map, r->map_len);
+  fclose(r->stream);
+  free(r->buf);
+  free(r);
+}
 
 /*
- * Digits to Text
- * --------------
- *
- * Internally, we represent digits as bytes between 1 and 9, but
- * for input and output we'll be dealing with characters '1'
- * though '9'. These macros provide this conversion.
+ * Read from the file at path, or from stdin if path is NULL.
  */
+reader *new_reader(char const *path)
+{
+  FILE *stream = path ? fopen(path, "r") : stdin;
+  if (!stream)
+    return NULL;
+  reader* r = malloc(sizeof(reader));
+  r->stream = stream;
+  r->buf = NULL;
+  r->len = 0;
+  r->map = NULL;
+  r->map_len = 0;
+  r->offset = 0;
+  r->line = NULL;
+  r->line_len = 0;
+  r->cells = SUDOKU_SIZE;
+  r->packed = false;
 
-#define DIGIT_TO_CHAR(d) ((char)(d + '0'))
-#define CHAR_TO_DIGIT(c) ((digit)(c - '0'))
+  struct stat st;
+  int fd = fileno(stream);
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      r->map = map;
+      r->map_len = st.st_size;
+    }
+  }
 
-/*
- * Digit Sets
- * ==========
- *
- * For each of the 81 positions on the Sudoku we'll want to keep track
- * of which of the 9 digits are (still) possible for that position.
- * (So, a set of the digits [1..9].
- * 
- * We represent this set using a short int (16 bit) where the bits 1
- * through 9 are set to 1 to indicate the presence of the corresponding
- * digit in the set. The other bits [0, 10..15] are always zero.
- *
- * Popcount (Hamming Distance)
- * ---------------------------
- *
- * To implement SET_SIZE blow, we require a way to conunt the number
- * of bits set to 1 (popcount).  GCC provides __builtin_popcount(n),
- * but the performance of same on ARM is underwhelming, so we use a
- * lookup table, which improves performance of the whole program by a
- * factor of 4 on the raspberry pi without reducing performance on
- * x86.
- */
-
-typedef unsigned short int digit_set;
-
-#define NO_DIGITS          ((digit_set)0)
-#define ALL_DIGITS         ((digit_set)0x03FE)
-#define SET_OF(digit)      ((digit_set)(1 << (digit)))
-#define IN_SET(set, digit) ((set & SET_OF(digit)) != 0)
-#define SET_SIZE(set)      (popcount_lut[(set) >> 1])
-
-const byte popcount_lut[512] = {
-  0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
-  1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-  1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8,
-  1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8,
-  2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8,
-  3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-  4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8,
-  4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8,
-  5, 6, 6, 7, 6, 7, 7, 8, 6, 7, 7, 8, 7, 8, 8, 9
-};
+  if (r->map) {
+    r->packed = r->map_len >= PACKED_MAGIC_SIZE &&
+      memcmp(r->map, packed_puzzle_magic, PACKED_MAGIC_SIZE) == 0;
+    if (r->packed)
+      r->offset = PACKED_MAGIC_SIZE;
+  } else {
+    int c = getc(stream);
+    if (c == packed_puzzle_magic[0]) {
+      unsigned char magic[PACKED_MAGIC_SIZE] = { c };
+      if (fread(magic + 1, 1, PACKED_MAGIC_SIZE - 1, stream) != PACKED_MAGIC_SIZE - 1 ||
+          memcmp(magic, packed_puzzle_magic, PACKED_MAGIC_SIZE) != 0) {
+        free_reader(r);
+        errno = EINVAL;
+        return NULL;
+      }
+      r->packed = true;
+    } else if (c != EOF) {
+      ungetc(c, stream);
+    }
+  }
+  return r;
+}
 
 /*
- * Representing the Sudoku Board
- * =============================
- * 
- * The sudoku board has 81 positions arranged in a square with 9 rows
- * and 9 columns.  We follow the convention of numbering the positions
- * from 0 to 80 beginning in the upper left corner and working our way
- * across each row from left to right before dropping down to the next
- * row below.
- *
- *  0  1  2 |  3  4  5 |  6  7  8 
- *  9 10 11 | 12 13 14 | 15 16 17 
- * 18 19 20 | 21 22 23 | 24 25 26 
- * ---------+----------+---------
- * 27 28 29 | 30 31 32 | 33 34 35
- * 36 37 38 | 39 40 41 | 42 43 44 
- * 45 46 47 | 48 49 50 | 51 52 53
- * ---------+----------+--------- 
- * 54 55 56 | 57 58 59 | 60 61 62 
- * 63 64 65 | 66 67 68 | 69 70 71 
- * 72 73 74 | 75 76 77 | 78 79 80
- *
- */
-
-#define SUDOKU_SIZE 81
-
-/*
- * A byte suffices to name any position on the Sudoku board.
- * (Positions are numbered [0 .. 80].)
- */
-typedef byte pos; 
-
-/*
- * Determining Neighbors
- * ---------------------
- *
- * Each of the 81 positions of the sudoku board is influenced by
- * exactly 20 other positions, which we refer to as neighbors.  The
- * neighbors of position P include all the positions that share P's
- * row, column or quadrant without duplicates and without P itself.
- *
- * A position may only contain a digit not contained by any of its
- * neighbors.
- */
-
-#define NUM_NEIGHBORS 20
-
-/*
- * For each position, we record the positions of its 20 neighbors.
- *
- * This array was computed once with a separate program and then
- * simply include here, which is more efficient than computing it
- * every time the program starts up.
- */
-static const pos neighbors[SUDOKU_SIZE][NUM_NEIGHBORS] = {
-    { 1, 9, 2,18, 3,27, 4,36,10, 5,45,11, 6,54, 7,63,19, 8,72,20},
-    { 0,10, 2,19, 3,28, 9, 4,37, 5,46,11, 6,55,18, 7,64, 8,73,20},
-    { 0, 1,11,20, 3,29, 9, 4,38,10, 5,47, 6,56,18, 7,65,19, 8,74},
-    { 0, 1,12, 4, 2,21, 5,30,39,13,48,14, 6,57, 7,66,22, 8,75,23},
-    { 0, 3, 1,13, 2,22, 5,31,12,40,49,14, 6,58,21, 7,67, 8,76,23},
-    { 0, 3, 1,14, 4, 2,23,32,12,41,13,50, 6,59,21, 7,68,22, 8,77},
-    { 0, 1,15, 7, 2,24, 8, 3,33, 4,42,16, 5,51,17,60,69,25,78,26},
-    { 0, 6, 1,16, 2,25, 8, 3,34,15, 4,43, 5,52,17,61,24,70,79,26},
-    { 0, 6, 1,17, 7, 2,26, 3,35,15, 4,44,16, 5,53,62,24,71,25,80},
-    { 0,10, 1,11,18, 2,12,27,13,36,14,45,15,54,16,63,19,17,72,20},
-    { 9, 1, 0,11,19, 2,12,28,13,37,14,46,15,55,18,16,64,17,73,20},
-    { 9, 2, 0,10, 1,20,12,29,13,38,14,47,15,56,18,16,65,19,17,74},
-    { 9, 3,10, 4,11,21, 5,30,13,39,14,48,15,57,16,66,22,17,75,23},
-    { 9, 4, 3,10,11,22, 5,12,31,40,14,49,15,58,21,16,67,17,76,23},
-    { 9, 5, 3,10, 4,11,23,12,32,13,41,50,15,59,21,16,68,22,17,77},
-    { 9, 6,10, 7,11,24, 8,12,33,13,42,16,14,51,17,60,69,25,78,26},
-    { 9, 7, 6,10,11,25, 8,12,34,15,13,43,14,52,17,61,24,70,79,26},
-    { 9, 8, 6,10, 7,11,26,12,35,15,13,44,16,14,53,62,24,71,25,80},
-    { 0,19, 9, 1,20, 2,21,27,22,36,10,23,45,11,24,54,25,63,26,72},
-    {18, 1, 0,10,20, 2,21,28, 9,22,37,23,46,11,24,55,25,64,26,73},
-    {18, 2, 0,19,11, 1,21,29, 9,22,38,10,23,47,24,56,25,65,26,74},
-    {18, 3,19,12, 4,20, 5,30,22,39,13,23,48,14,24,57,25,66,26,75},
-    {18, 4, 3,19,13,20, 5,21,31,12,40,23,49,14,24,58,25,67,26,76},
-    {18, 5, 3,19,14, 4,20,21,32,12,22,41,13,50,24,59,25,68,26,77},
-    {18, 6,19,15, 7,20, 8,21,33,22,42,16,23,51,17,60,25,69,26,78},
-    {18, 7, 6,19,16,20, 8,21,34,15,22,43,23,52,17,24,61,70,26,79},
-    {18, 8, 6,19,17, 7,20,21,35,15,22,44,16,23,53,24,62,25,71,80},
-    { 0,28, 9,29,18,30,36,31,37,32,45,38,33,54,34,63,46,35,72,47},
-    {27, 1,10,29,19,30,36,31,37,32,46,38,33,55,45,34,64,35,73,47},
-    {27, 2,28,11,20,30,36,31,38,37,32,47,33,56,45,34,65,46,35,74},
-    {27, 3,28,12,31,29,21,32,39,40,48,41,33,57,34,66,49,35,75,50},
-    {27, 4,30,28,13,29,22,32,39,40,49,41,33,58,48,34,67,35,76,50},
-    {27, 5,30,28,14,31,29,23,39,41,40,50,33,59,48,34,68,49,35,77},
-    {27, 6,28,15,34,29,24,35,30,42,31,43,32,51,44,60,69,52,78,53},
-    {27, 7,33,28,16,29,25,35,30,42,31,43,32,52,44,61,51,70,79,53},
-    {27, 8,33,28,17,34,29,26,30,42,31,44,43,32,53,62,51,71,52,80},
-    { 0,27,37, 9,28,38,18,29,39,40,41,45,42,54,43,63,46,44,72,47},
-    {36, 1,27,10,28,38,19,29,39,40,41,46,42,55,45,43,64,44,73,47},
-    {36, 2,27,37,11,28,20,29,39,40,41,47,42,56,45,43,65,46,44,74},
-    {36, 3,30,37,12,31,38,21,32,40,41,48,42,57,43,66,49,44,75,50},
-    {36, 4,30,37,13,31,38,22,32,39,41,49,42,58,48,43,67,44,76,50},
-    {36, 5,30,37,14,31,38,23,32,39,40,50,42,59,48,43,68,49,44,77},
-    {36, 6,33,37,15,34,38,24,35,39,40,43,41,51,44,60,69,52,78,53},
-    {36, 7,33,37,16,34,38,25,35,39,42,40,41,52,44,61,51,70,79,53},
-    {36, 8,33,37,17,34,38,26,35,39,42,40,43,41,53,62,51,71,52,80},
-    { 0,27,46, 9,28,47,18,29,48,36,49,37,50,38,51,54,52,63,53,72},
-    {45, 1,27,10,28,47,19,29,48,36,49,37,50,38,51,55,52,64,53,73},
-    {45, 2,27,46,11,28,20,29,48,36,49,38,37,50,51,56,52,65,53,74},
-    {45, 3,30,46,12,31,47,21,32,39,49,40,50,41,51,57,52,66,53,75},
-    {45, 4,30,46,13,31,47,22,32,48,39,40,50,41,51,58,52,67,53,76},
-    {45, 5,30,46,14,31,47,23,32,48,39,49,41,40,51,59,52,68,53,77},
-    {45, 6,33,46,15,34,47,24,35,48,42,49,43,50,44,60,52,69,53,78},
-    {45, 7,33,46,16,34,47,25,35,48,42,49,43,50,44,51,61,70,53,79},
-    {45, 8,33,46,17,34,47,26,35,48,42,49,44,43,50,51,62,52,71,80},
-    { 0,55, 9,56,18,57,27,63,58,36,64,59,45,65,60,72,61,73,62,74},
-    {54, 1,10,56,19,57,28,63,58,37,64,59,46,65,60,72,61,73,62,74},
-    {54, 2,55,11,20,57,29,63,58,38,64,59,47,65,60,72,61,73,62,74},
-    {54, 3,55,12,58,56,21,59,30,66,39,67,48,68,60,75,61,76,62,77},
-    {54, 4,57,55,13,56,22,59,31,66,40,67,49,68,60,75,61,76,62,77},
-    {54, 5,57,55,14,58,56,23,32,66,41,67,50,68,60,75,61,76,62,77},
-    {54, 6,55,15,61,56,24,62,57,33,69,58,42,70,59,51,71,78,79,80},
-    {54, 7,60,55,16,56,25,62,57,34,69,58,43,70,59,52,71,78,79,80},
-    {54, 8,60,55,17,61,56,26,57,35,69,58,44,70,59,53,71,78,79,80},
-    { 0,54,64, 9,55,65,18,56,66,27,67,36,68,45,69,72,70,73,71,74},
-    {63, 1,54,10,55,65,19,56,66,28,67,37,68,46,69,72,70,73,71,74},
-    {63, 2,54,64,11,55,20,56,66,29,67,38,68,47,69,72,70,73,71,74},
-    {63, 3,57,64,12,58,65,21,59,30,67,39,68,48,69,75,70,76,71,77},
-    {63, 4,57,64,13,58,65,22,59,66,31,40,68,49,69,75,70,76,71,77},
-    {63, 5,57,64,14,58,65,23,59,66,32,67,41,50,69,75,70,76,71,77},
-    {63, 6,60,64,15,61,65,24,62,66,33,67,42,70,68,51,71,78,79,80},
-    {63, 7,60,64,16,61,65,25,62,66,34,69,67,43,68,52,71,78,79,80},
-    {63, 8,60,64,17,61,65,26,62,66,35,69,67,44,70,68,53,78,79,80},
-    { 0,54,73, 9,55,74,18,56,75,27,63,76,36,64,77,45,65,78,79,80},
-    {72, 1,54,10,55,74,19,56,75,28,63,76,37,64,77,46,65,78,79,80},
-    {72, 2,54,73,11,55,20,56,75,29,63,76,38,64,77,47,65,78,79,80},
-    {72, 3,57,73,12,58,74,21,59,30,66,76,39,67,77,48,68,78,79,80},
-    {72, 4,57,73,13,58,74,22,59,75,31,66,40,67,77,49,68,78,79,80},
-    {72, 5,57,73,14,58,74,23,59,75,32,66,76,41,67,50,68,78,79,80},
-    {72, 6,60,73,15,61,74,24,62,75,33,69,76,42,70,77,51,71,79,80},
-    {72, 7,60,73,16,61,74,25,62,75,34,69,76,43,70,77,52,71,78,80},
-    {72, 8,60,73,17,61,74,26,62,75,35,69,76,44,70,77,53,71,78,79}
-  };
+ * Make r->text the next packed puzzle.
+ */
+static bool read_packed(reader *r)
+{
+  size_t n;
+  if (r->map) {
+    if (r->offset >= r->map_len)
+      return false;
+    n = unpack_puzzle(r->text, (unsigned char const *)r->map + r->offset,
+                      r->map_len - r->offset);
+  } else {
+    unsigned char b[PACKED_PUZZLE_MAX];
+    n = fread(b, 1, PACKED_BITMAP_SIZE, r->stream);
+    if (n == 0)
+      return false;
+    if (n == PACKED_BITMAP_SIZE) {
+      size_t size = packed_puzzle_size(b);
+      n += fread(b + n, 1, size - n, r->stream);
+      n = unpack_puzzle(r->text, b, n);
+    } else {
+      n = 0;
+    }
+  }
+  if (n == 0) {
+    fprintf(stderr, "truncated packed puzzle\n");
+    return false;
+  }
+  r->offset += n;
+  r->line = r->text;
+  r->line_len = SUDOKU_SIZE;
+  return true;
+}
 
 /*
- * Internal Sudoku Board
- * ---------------------
- * 
- * Internally, we represent the sudoku board with 81 digit sets.
- * For each position we record the digits that are possible at
- * that position given to cofiguration of the rest of the board.
+ * Make r->line and r->line_len the next line of input.  Returns
+ * false at end of input.
  */
-
-typedef struct {
-  digit_set free[SUDOKU_SIZE];
-} sudoku;
-
-void revoke(sudoku *s, pos p, digit_set ds)
+bool read_line(reader *r)
 {
-  for (int i = 0; i < NUM_NEIGHBORS; i++) {
-    pos n = neighbors[p][i];
-    bool was_open = SET_SIZE(s->free[n]) > 1;
-    s->free[n] &= ~ds;
-    if (was_open && SET_SIZE(s->free[n]) == 1)
-      revoke(s, n, s->free[n]);
+  size_t n;
+  if (r->packed)
+    return read_packed(r);
+  if (r->map) {
+    if (r->offset >= r->map_len)
+      return false;
+    char const *start = r->map + r->offset;
+    char const *end = memchr(start, '\n', r->map_len - r->offset);
+    n = end ? (size_t)(end - start) : r->map_len - r->offset;
+    r->offset += n + 1;
+    r->line = start;
+  } else {
+    ssize_t line_len = getline(&r->buf, &r->len, r->stream);
+    if (line_len < 0) {
+      /*
+       * This is how getline signals end of input (or error), so
+       * return false to let our caller know that there are no more
+       * puzzles to be had.
+       */
+      return false;
+    }
+    n = line_len;
+    if (n > 0 && r->buf[n - 1] == '\n')
+      n--;
+    r->line = r->buf;
   }
+  if (n > 0 && r->line[n - 1] == '\r')
+    n--;
+  r->line_len = (n > r->cells) ? r->cells : n;
+  return true;
 }
 
-void claim(sudoku *s, pos p, digit d)
+bool read_sudoku(reader *r, solver *s)
 {
-  assert(IN_SET(s->free[p], d));
-  revoke(s, p, s->free[p] = SET_OF(d));
+  if (!read_line(r))
+    return false;
+  /* Parse the line into the solver's sudoku. */
+  sudoku_from_text(&s->sudoku, r->line, r->line_len);
+  clear_counts(s);
+  return true;
 }
 
 
 /*
- * Sudoku Solver
- * =============
- * 
- * The solver is a data structure which holds the Sudoku to
- * be solved as well as some additional metadata.
- */
-
-typedef struct {
-  sudoku sudoku;
-  struct {
-    int backtrack;
-    int choice;
-  } count;
-  array solutions;
-} solver;
-
-/*
- * Find the position which we'll next try to solve for.
+ * Writer
+ * ------
+ *
+ * Each puzzle produces one line per solution kept (or a single line
+ * with solution number 0 and no solution if none was). The line
+ * repeats the puzzle as read, the choice and backtrack counts, the
+ * solution number, the number of solutions found and the solution
+ * itself, exactly as
  *
- * If the position returned has 0 degrees of freedom, then the
- * puzzle's current configuration violates the rules of sudoku and
- * cann not be solved.
+ *   printf("%81s %8d %8d %1d %1d %81s\n", ...)
  *
- * If the position returned has 1 degree of freedom, then the puzzle
- * has been successfully solved.
+ * would, but formatted by hand into a large buffer.  A search that
+ * gave up over its budget (--max-choices, --timeout) gets a single
+ * line with solution number 0, the solutions found so far, and the
+ * word "aborted" in place of a solution.  A writer either
+ * hands its buffer to a stream in one large fwrite whenever it runs
+ * low on room, which stdio passes straight through to write(), or
+ * (without a stream) grows it to hold everything.
  *
- * If the position returned has 2 or more degrees of freedom, then the
- * possible digits should be explored until a solution is found.
+ * A packed writer instead writes one packed result (see packed.c)
+ * per puzzle, and a grade writer one line with the puzzle's grade.
  */
-pos next_move(solver const *s)
+
+#define WRITER_SIZE (1 << 20)
+#define MAX_RECORD  256 /* comfortably more than a formatted line */
+
+typedef struct {
+  FILE  *stream;
+  char  *buf;
+  size_t len;
+  size_t cap;
+  output_format format;
+} writer;
+
+writer *new_writer(FILE *stream, size_t size, output_format format)
 {
-  int p = 0, m = 10, i;
-  for (i = 0; i < SUDOKU_SIZE; i++) {
-    int n = SET_SIZE(s->sudoku.free[i]);
-    if (n == 0) {
-      /*
-       * n == 0 implies that the current puzzle configuration is
-       * unsolveable. Our caller will detect this and backtrack.
-       */
-      p = i;
-      break;
-    }
-    if (n > 1 && n < m) {
-      /*
-       * The primary goal of the surrounding loop is to find
-       * the free position with the fewest degrees of freedom.
-       */
-      m = n;
-      p = i;
-    }
+  writer *w = malloc(sizeof(writer));
+  w->stream = stream;
+  w->format = format;
+  w->cap = size;
+  w->buf = malloc(w->cap);
+  w->len = 0;
+  return w;
+}
+
+void writer_flush(writer *w)
+{
+  if (w->stream && fwrite(w->buf, 1, w->len, w->stream) != w->len) {
+    perror("write");
+    exit(1);
   }
-  /*
-   * If we never found (n > 1 && n < m) then we may reach this
-   * point with p referring to a position that is fixed (1 degree
-   * of freedom.)  This indicates that the puzzle has been solved.
-   */
-  return p;
+  w->len = 0;
 }
 
-bool solve(solver *s)
+writer *free_writer(writer *w)
 {
-  pos p = next_move(s);
-  s->count.choice++;
+  if (w) {
+    writer_flush(w);
+    free(w->buf);
+    free(w);
+  }
+  return NULL;
+}
 
-  digit_set dsp = s->sudoku.free[p];
-  int n = SET_SIZE(dsp);
-  if (n == 0)
-    return false;
+/* Make room for at least n more bytes. */
+static char *writer_room(writer *w, size_t n)
+{
+  if (w->cap - w->len < n && w->stream)
+    writer_flush(w);
+  while (w->cap - w->len < n) {
+    w->cap *= 2;
+    w->buf = realloc(w->buf, w->cap);
+  }
+  return w->buf + w->len;
+}
+
+/* Make room for at least one more line. */
+static char *writer_reserve(writer *w)
+{
+  return writer_room(w, MAX_RECORD);
+}
+
+/* Write n right aligned in a field of width characters, like "%*d". */
+static char *put_int(char *t, long n, int width)
+{
+  char digits[21];
+  int i = sizeof(digits);
+  unsigned long u = (n < 0) ? -(unsigned long)n : (unsigned long)n;
+  do {
+    digits[--i] = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  if (n < 0)
+    digits[--i] = '-';
+  int len = sizeof(digits) - i;
+  for (; width > len; width--)
+    *t++ = ' ';
+  memcpy(t, digits + i, len);
+  return t + len;
+}
+
+/* Write the puzzle text right aligned in width characters. */
+static char *put_padded(char *t, char const *text, size_t len, size_t width)
+{
+  memset(t, ' ', width - len);
+  memcpy(t + width - len, text, len);
+  return t + width;
+}
+
+static char *put_text(char *t, char const *text, size_t len)
+{
+  return put_padded(t, text, len, SUDOKU_SIZE);
+}
+
+static char *put_counts(char *t, int choice, int backtrack, int i, long n)
+{
+  *t++ = ' ';
+  t = put_int(t, choice, 8);
+  *t++ = ' ';
+  t = put_int(t, backtrack, 8);
+  *t++ = ' ';
+  t = put_int(t, i, 1);
+  *t++ = ' ';
+  return put_int(t, n, 1);
+}
+
+static void print_packed(writer *w, char const *text, size_t len, solver *v)
+{
+  char puzzle[SUDOKU_SIZE];
+  memset(puzzle, '.', SUDOKU_SIZE);
+  for (size_t i = 0; i < len; i++)
+    if ('1' <= text[i] && text[i] <= '9')
+      puzzle[i] = text[i];
 
-  if (n == 1) {
-    array_push(s->solutions, &s->sudoku);
-    return (array_length(s->solutions) == array_capacity(s->solutions));
+  int n = sudoku_stack_length(v->solutions);
+  unsigned char *b = (unsigned char *)writer_reserve(w);
+  b += pack_puzzle(b, puzzle, SUDOKU_SIZE);
+  b += pack_uint(b, v->count.choice);
+  b += pack_uint(b, v->count.backtrack);
+  b += pack_uint(b, n);
+  w->len = (char *)b - w->buf;
+  for (int i = 0; i < n; i++) {
+    char solution[SUDOKU_SIZE + 1];
+    sudoku_to_text(sudoku_stack_pop(v->solutions), solution);
+    b = (unsigned char *)writer_reserve(w);
+    b += pack_solution(b, puzzle, solution);
+    w->len = (char *)b - w->buf;
   }
+}
 
-  sudoku r = s->sudoku;
-  for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++) {
-    if (IN_SET(dsp, d)) {
-      claim(&s->sudoku, p, d);
-      if (solve(s)) {
-          return true;
-      }
-      s->count.backtrack++;
-      s->sudoku = r;
+static void print_grade(writer *w, char const *text, size_t len, solver *v)
+{
+  char const *name = technique_name(v->grade.hardest);
+  char *t = writer_reserve(w);
+  t = put_text(t, text, len);
+  *t++ = ' ';
+  t = put_int(t, v->grade.score, 6);
+  *t++ = ' ';
+  t = stpcpy(t, name);
+  *t++ = '\n';
+  w->len = t - w->buf;
+}
+
+void print_solutions(writer *w, char const *text, size_t len, solver *v)
+{
+  if (w->format == PACKED_RESULTS) {
+    print_packed(w, text, len, v);
+    return;
+  }
+  if (w->format == GRADES) {
+    print_grade(w, text, len, v);
+    return;
+  }
+  int n = sudoku_stack_length(v->solutions);
+  if (n == 0 || v->count.aborted) {
+    char *t = writer_reserve(w);
+    t = put_text(t, text, len);
+    t = put_counts(t, v->count.choice, v->count.backtrack, 0, v->count.found);
+    if (v->count.aborted) {
+      sudoku_stack_clear(v->solutions);
+      t = stpcpy(t, " aborted");
     }
+    *t++ = '\n';
+    w->len = t - w->buf;
+    return;
+  }
+  for (int i = 0; i < n; i++) {
+    sudoku const *s = sudoku_stack_pop(v->solutions);
+    char *t = writer_reserve(w);
+    t = put_text(t, text, len);
+    t = put_counts(t, v->count.choice, v->count.backtrack, i + 1, v->count.found);
+    *t++ = ' ';
+    sudoku_to_text(s, t);
+    t += SUDOKU_SIZE;
+    *t++ = '\n';
+    w->len = t - w->buf;
   }
-  return array_length(s->solutions) > 0;
 }
 
-solver *clear_counts(solver *v)
-{
-  v->count.backtrack = 0;
-  v->count.choice = 0;
-  return v;
-}  
+/*
+ * Solution Cache
+ * ==============
+ *
+ * Feeds generated by applying the symmetries of sudoku to a few seed
+ * puzzles are full of copies of the same puzzle in disguise.  With
+ * -c N the solver remembers the solutions of up to N puzzles, each
+ * under the canonical form of its class, and solves any later puzzle
+ * in the same class by mapping the remembered solutions back instead
+ * of searching again.
+ *
+ * The symmetries are transposition, permuting the three bands (rows
+ * of boxes) or the three stacks (columns of boxes), permuting the
+ * rows within a band or the columns within a stack, and relabeling
+ * the digits.  Rotations and reflections are compositions of these.
+ *
+ * Canonical Form
+ * --------------
+ *
+ * The puzzle is taken to be the cells the solver has fixed after
+ * reading it (the givens and the naked singles they imply), which
+ * has the same solutions as the givens alone.
+ *
+ * The canonical form is the least grid, compared cell by cell in row
+ * major order with open cells as 0, among the transformations of the
+ * puzzle with digits relabeled 1, 2, ... in order of appearance.
+ * Trying all 2 * 6^8 arrangements of rows and columns would take far
+ * too long, so only those are tried that sort the rows and columns by
+ * a key that no symmetry changes: the number of fixed cells in the
+ * line, and a hash of the counts of the crossing lines through them
+ * and of how often their digits occur in the puzzle.  Rows are sorted
+ * within each band, bands by their rows' keys, and likewise columns;
+ * the orientation sorts first by the rows' keys and then the
+ * columns'.  Only ties leave more than one arrangement to try.
+ * Puzzles with too many ties (CANON_LIMIT) are solved uncached.
+ *
+ * Cache
+ * -----
+ *
+ * The cache is a hash table split into CACHE_SHARDS shards, each
+ * with its own lock, table and least recently used list, so that
+ * workers with -j mostly take different locks.  Each shard holds at
+ * most its share of N entries and evicts the least recently used one
+ * to make room.  An entry holds the canonical puzzle and up to
+ * CACHE_SOLS solutions in canonical labels.
+ *
+ * A puzzle solved from the cache reports zero choices and zero
+ * backtracks.  It reports the right number of solutions, but for a
+ * puzzle with several they need not be those a search would find.
+ */
+
+#define CANON_LIMIT  4096
+#define CACHE_SHARDS 16
+#define CACHE_SOLS   2
+
+typedef struct {
+  byte     key[SUDOKU_SIZE];   /* the canonical puzzle */
+  byte     cell[SUDOKU_SIZE];  /* puzzle position of each key position */
+  digit    label[10];          /* puzzle digit to canonical digit */
+  digit    unlabel[10];        /* and back */
+  uint64_t hash;
+  bool     ok;                 /* false if not cacheable */
+} canon;
+
+typedef struct {
+  uint64_t hash;
+  int      next;               /* next entry in the same bucket */
+  int      newer, older;       /* neighbours in the LRU list */
+  int      count;              /* number of solutions */
+  byte     key[SUDOKU_SIZE];
+  byte     sol[CACHE_SOLS][SUDOKU_SIZE];
+} cache_entry;
+
+typedef struct {
+  pthread_mutex_t lock;
+  cache_entry *entry;
+  int    *bucket;              /* first entry of each bucket, or -1 */
+  int     buckets;             /* a power of 2 */
+  int     size, cap;
+  int     newest, oldest;      /* ends of the LRU list, or -1 */
+  size_t  hits, misses, evictions;
+} cache_shard;
 
-solver *new_solver(size_t max_sols)
+typedef struct cache {
+  cache_shard shard[CACHE_SHARDS];
+  size_t      skipped;         /* puzzles not cacheable */
+} cache;
+
+cache *new_cache(size_t entries)
 {
-  solver *v = calloc(sizeof(solver), 1);
-  v->solutions = array_alloc(max_sols, sizeof(sudoku));
-  return v;
+  cache *c = calloc(1, sizeof(cache));
+  for (int i = 0; i < CACHE_SHARDS; i++) {
+    cache_shard *h = &c->shard[i];
+    pthread_mutex_init(&h->lock, NULL);
+    h->cap = (entries + CACHE_SHARDS - 1) / CACHE_SHARDS;
+    h->entry = malloc(h->cap * sizeof(cache_entry));
+    for (h->buckets = 1; h->buckets < h->cap; h->buckets *= 2)
+      ;
+    h->bucket = malloc(h->buckets * sizeof(int));
+    for (int b = 0; b < h->buckets; b++)
+      h->bucket[b] = -1;
+    h->newest = h->oldest = -1;
+  }
+  return c;
 }
 
-solver *free_solver(solver *v)
+/*
+ * Free the cache, reporting its hit rate on stderr.
+ */
+cache *free_cache(cache *c)
 {
-  if (v) {
-    array_free(v->solutions);
-    free(v);
+  if (!c)
+    return NULL;
+  size_t hits = 0, misses = 0, evictions = 0;
+  for (int i = 0; i < CACHE_SHARDS; i++) {
+    cache_shard *h = &c->shard[i];
+    hits += h->hits;
+    misses += h->misses;
+    evictions += h->evictions;
+    pthread_mutex_destroy(&h->lock);
+    free(h->entry);
+    free(h->bucket);
   }
+  size_t lookups = hits + misses;
+  fprintf(stderr, "cache: %zu lookups, %zu hits (%.1f%%), %zu evictions, %zu not cacheable\n",
+          lookups, hits, lookups ? 100.0 * hits / lookups : 0.0, evictions,
+          __atomic_load_n(&c->skipped, __ATOMIC_RELAXED));
+  free(c);
   return NULL;
 }
 
 /*
- * Input/Output
- * ============
- *
- * We need to be able to read puzzles from stdin and write
- * their solutions and other ancilliary information to stdout.
+ * Canonical Form
+ * --------------
  */
 
+static uint64_t mix(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return x;
+}
+
 /*
- * Textual Sudoku Board
- * --------------------
- *
- * The textual sudoku board is a string of 81 chars. Fixed
- * positions are marked by the characters '1' though '9'. 
- * Open positions (to be solved for) may be marked by
- * any character, though '.' is used by convention.
+ * The orderings of three lines allowed by their keys: all those
+ * that leave the keys nondecreasing.
  */
+static const byte perm3[6][3] = {
+  {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+};
+
+typedef struct {
+  int  count;
+  byte line[CANON_LIMIT][9];
+} arrangements;
+
+static int compare_triples(uint64_t const *a, uint64_t const *b)
+{
+  for (int i = 0; i < 3; i++)
+    if (a[i] != b[i])
+      return a[i] < b[i] ? -1 : 1;
+  return 0;
+}
 
 /*
- * Copy a textual representation of the sudoku s to the string pointed
- * to be t, which must point to at least SUDOKU_SIZE+1 bytes of
- * storage.
+ * Fill a with the orderings of the 9 lines that sort them by key,
+ * within each group of three and the groups by their sorted keys.
+ * Returns false if there are more than CANON_LIMIT.
  */
-void sudoku_to_text(sudoku const *s, char *t) 
+static bool arrange(uint64_t const *key, arrangements *a, uint64_t *sorted)
+{
+  byte within[3][6][3];
+  int nwithin[3];
+  uint64_t triple[3][3];
+  for (int g = 0; g < 3; g++) {
+    nwithin[g] = 0;
+    for (int p = 0; p < 6; p++) {
+      uint64_t const *k = key + 3 * g;
+      byte const *q = perm3[p];
+      if (k[q[0]] <= k[q[1]] && k[q[1]] <= k[q[2]]) {
+        for (int i = 0; i < 3; i++)
+          within[g][nwithin[g]][i] = 3 * g + q[i];
+        nwithin[g]++;
+      }
+    }
+    for (int i = 0; i < 3; i++)
+      triple[g][i] = key[within[g][0][i]];
+  }
+
+  a->count = 0;
+  for (int p = 0; p < 6; p++) {
+    byte const *q = perm3[p];
+    if (compare_triples(triple[q[0]], triple[q[1]]) > 0 ||
+        compare_triples(triple[q[1]], triple[q[2]]) > 0)
+      continue;
+    if (a->count == 0)
+      for (int g = 0; g < 3; g++)
+        memcpy(sorted + 3 * g, triple[q[g]], sizeof(triple[0]));
+    int n = nwithin[q[0]] * nwithin[q[1]] * nwithin[q[2]];
+    if (a->count + n > CANON_LIMIT)
+      return false;
+    for (int i = 0; i < n; i++) {
+      byte *line = a->line[a->count++];
+      int rest = i;
+      for (int g = 0; g < 3; g++) {
+        memcpy(line + 3 * g, within[q[g]][rest % nwithin[q[g]]], 3);
+        rest /= nwithin[q[g]];
+      }
+    }
+  }
+  return true;
+}
+
+/* The digit fixed at each position, 0 if open; false on a conflict. */
+static bool fixed_digits(sudoku const *s, byte *grid)
 {
   for (int i = 0; i < SUDOKU_SIZE; i++) {
-    switch(SET_SIZE(s->free[i])) {
-    case 0:
-      t[i] = '#';
-      break;
-    case 1:
-      for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++)
-        if (IN_SET(s->free[i], d)) {
-          t[i] = DIGIT_TO_CHAR(d);
-          break;
-        }
-      break;
-    default:
-      t[i] = '.';
+    digit_set ds = s->free[i];
+    if (ds == NO_DIGITS)
+      return false;
+    grid[i] = (SET_SIZE(ds) == 1) ? __builtin_ctz(ds) : 0;
+  }
+  return true;
+}
+
+/*
+ * Compare the puzzle under the arrangement (t, row, col) with the
+ * best found so far, relabeling as we go, and make it the best if it
+ * is less.
+ */
+static void try_arrangement(byte const *grid, bool t, byte const *row, byte const *col,
+                            canon *k, bool *first)
+{
+  digit label[10] = {0};
+  digit next = 1;
+  int i = 0;
+  if (!*first) {
+    for (; i < SUDOKU_SIZE; i++) {
+      int r = row[i / 9], c = col[i % 9];
+      byte d = grid[t ? 9 * c + r : 9 * r + c];
+      if (d && !label[d])
+        label[d] = next++;
+      if (label[d] != k->key[i]) {
+        if (label[d] > k->key[i])
+          return;
+        break;
+      }
     }
+    if (i == SUDOKU_SIZE)
+      return;
+    memset(label, 0, sizeof(label));
+    next = 1;
   }
-  t[SUDOKU_SIZE] = '\0';
+  for (i = 0; i < SUDOKU_SIZE; i++) {
+    int r = row[i / 9], c = col[i % 9];
+    int p = t ? 9 * c + r : 9 * r + c;
+    byte d = grid[p];
+    if (d && !label[d])
+      label[d] = next++;
+    k->key[i] = label[d];
+    k->cell[i] = p;
+  }
+  memcpy(k->label, label, sizeof(label));
+  *first = false;
 }
 
-void sudoku_from_text(sudoku *s, char const *t)
+/*
+ * Compute the canonical form of s into k.  Leaves k->ok false if s
+ * is not worth caching.
+ */
+static void canonicalize(sudoku const *s, canon *k)
 {
-  for (int i = 0; i < SUDOKU_SIZE; i++)
-    s->free[i] = ALL_DIGITS;
+  static __thread arrangements rows, cols;
+  byte grid[SUDOKU_SIZE];
+  k->ok = false;
+  if (!fixed_digits(s, grid))
+    return;
 
-  for (int i = 0; i < SUDOKU_SIZE && t[i]; i++) {
-    char c = t[i];
-    if ('1' <= c && c <= '9')
-      claim(s, i, CHAR_TO_DIGIT(c));
+  int freq[10] = {0}, rc[9] = {0}, cc[9] = {0};
+  for (int i = 0; i < SUDOKU_SIZE; i++)
+    if (grid[i]) {
+      freq[grid[i]]++;
+      rc[ROW_OF(i)]++;
+      cc[COL_OF(i)]++;
+    }
+  uint64_t rkey[9], ckey[9];
+  for (int l = 0; l < 9; l++) {
+    rkey[l] = (uint64_t)rc[l] << 56;
+    ckey[l] = (uint64_t)cc[l] << 56;
   }
+  for (int i = 0; i < SUDOKU_SIZE; i++)
+    if (grid[i]) {
+      uint64_t f = mix(1000 + freq[grid[i]]);
+      rkey[ROW_OF(i)] += (mix(cc[COL_OF(i)]) + f) >> 8;
+      ckey[COL_OF(i)] += (mix(rc[ROW_OF(i)]) + f) >> 8;
+    }
+
+  uint64_t sorted[18];
+  if (!arrange(rkey, &rows, sorted) || !arrange(ckey, &cols, sorted + 9))
+    return;
+
+  /*
+   * Transposed, the columns become the rows: compare the row keys
+   * with the column keys to choose the orientation.
+   */
+  int cmp = 0;
+  for (int i = 0; i < 9 && !cmp; i++)
+    if (sorted[i] != sorted[9 + i])
+      cmp = sorted[i] < sorted[9 + i] ? -1 : 1;
+  if ((cmp == 0 ? 2 : 1) * (long)rows.count * cols.count > CANON_LIMIT)
+    return;
+
+  bool first = true;
+  if (cmp <= 0)
+    for (int r = 0; r < rows.count; r++)
+      for (int c = 0; c < cols.count; c++)
+        try_arrangement(grid, false, rows.line[r], cols.line[c], k, &first);
+  if (cmp >= 0)
+    for (int r = 0; r < cols.count; r++)
+      for (int c = 0; c < rows.count; c++)
+        try_arrangement(grid, true, cols.line[r], rows.line[c], k, &first);
+
+  /* digits the puzzle doesn't fix get the remaining labels in order */
+  digit next = 1;
+  for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++)
+    if (k->label[d] >= next)
+      next = k->label[d] + 1;
+  for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++)
+    if (!k->label[d])
+      k->label[d] = next++;
+  for (digit d = MIN_DIGIT; d <= MAX_DIGIT; d++)
+    k->unlabel[k->label[d]] = d;
+
+  k->hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < SUDOKU_SIZE; i++)
+    k->hash = (k->hash ^ k->key[i]) * 0x100000001b3ULL;
+  k->ok = true;
 }
 
 /*
- * Reader
+ * Lookup
  * ------
- *
- * The reader knows how to read sudokus from stdout.
  */
 
-typedef struct { 
-  FILE *stream;
-  char *buf;
-  size_t len;
-} reader;
+static cache_shard *shard_of(cache *c, canon const *k)
+{
+  return &c->shard[k->hash % CACHE_SHARDS];
+}
 
-reader *new_reader()
+static int find_entry(cache_shard *h, canon const *k)
 {
-  reader* r = malloc(sizeof(reader));
-  r->stream = stdin;
-  r->buf = NULL;
-  r->len = 0;
-  return r;
+  int e = h->bucket[(k->hash / CACHE_SHARDS) & (h->buckets - 1)];
+  while (e >= 0 && (h->entry[e].hash != k->hash ||
+                    memcmp(h->entry[e].key, k->key, SUDOKU_SIZE) != 0))
+    e = h->entry[e].next;
+  return e;
 }
 
-void free_reader(reader *r)
+static void lru_unlink(cache_shard *h, int e)
 {
-  fclose(r->stream);
-  free(r->buf);
-  free(r);
+  cache_entry *x = &h->entry[e];
+  if (x->newer >= 0)
+    h->entry[x->newer].older = x->older;
+  else
+    h->newest = x->older;
+  if (x->older >= 0)
+    h->entry[x->older].newer = x->newer;
+  else
+    h->oldest = x->newer;
 }
- 
-bool read_sudoku(reader *r, solver *s)
+
+static void lru_push(cache_shard *h, int e)
 {
-  ssize_t line_len;
-  line_len = getline(&r->buf, &r->len, r->stream);
-  if (line_len < 0) {
-    /*
-     * This is how getline signals end of input (or error), so return
-     * false to let our caller know that there are no more puzzles to
-     * be had.
-     */
-    r->buf[0] = '\0';
+  cache_entry *x = &h->entry[e];
+  x->newer = -1;
+  x->older = h->newest;
+  if (h->newest >= 0)
+    h->entry[h->newest].newer = e;
+  else
+    h->oldest = e;
+  h->newest = e;
+}
+
+/*
+ * Canonicalize v's sudoku into k and, if the cache has its solutions,
+ * make them v's.  Returns true if it did.
+ */
+bool cache_lookup(cache *c, solver *v, canon *k)
+{
+  if (!c)
+    return false;
+  canonicalize(&v->sudoku, k);
+  if (!k->ok) {
+    __atomic_fetch_add(&c->skipped, 1, __ATOMIC_RELAXED);
     return false;
   }
-  if (line_len > SUDOKU_SIZE) {
-    /* 
-     * Terminate buf at SUDOKU_SIZE, cutting off any newline character
-     * so that printing buf in verbose mode doesn't put an unwanted
-     * newline into our output.
-     */
-    r->buf[SUDOKU_SIZE] = '\0';
+
+  cache_shard *h = shard_of(c, k);
+  pthread_mutex_lock(&h->lock);
+  int e = find_entry(h, k);
+  if (e < 0) {
+    h->misses++;
+    pthread_mutex_unlock(&h->lock);
+    return false;
   }
-  /* Parse the text in buff into the solver's sudoku. */
-  sudoku_from_text(&s->sudoku, r->buf);
-  clear_counts(s);
+  h->hits++;
+  lru_unlink(h, e);
+  lru_push(h, e);
+  cache_entry const *x = &h->entry[e];
+  v->count.found = x->count;
+  for (int n = 0; n < x->count; n++) {
+    sudoku *s = sudoku_stack_emplace(v->solutions);
+    for (int i = 0; i < SUDOKU_SIZE; i++)
+      s->free[k->cell[i]] = SET_OF(k->unlabel[x->sol[n][i]]);
+  }
+  pthread_mutex_unlock(&h->lock);
   return true;
 }
 
+/*
+ * Remember the solutions v found for the puzzle canonicalized into
+ * k by cache_lookup.
+ */
+void cache_store(cache *c, solver const *v, canon const *k)
+{
+  int count = sudoku_stack_length(v->solutions);
+  if (!c || !k->ok || count > CACHE_SOLS)
+    return;
+
+  cache_shard *h = shard_of(c, k);
+  pthread_mutex_lock(&h->lock);
+  if (find_entry(h, k) >= 0) {
+    /* another worker got there first */
+    pthread_mutex_unlock(&h->lock);
+    return;
+  }
+  int e;
+  if (h->size < h->cap) {
+    e = h->size++;
+  } else {
+    e = h->oldest;
+    lru_unlink(h, e);
+    int *p = &h->bucket[(h->entry[e].hash / CACHE_SHARDS) & (h->buckets - 1)];
+    while (*p != e)
+      p = &h->entry[*p].next;
+    *p = h->entry[e].next;
+    h->evictions++;
+  }
+  cache_entry *x = &h->entry[e];
+  x->hash = k->hash;
+  memcpy(x->key, k->key, SUDOKU_SIZE);
+  x->count = count;
+  for (int n = 0; n < count; n++) {
+    sudoku const *s = sudoku_stack_at(v->solutions, n);
+    for (int i = 0; i < SUDOKU_SIZE; i++)
+      x->sol[n][i] = k->label[__builtin_ctz(s->free[k->cell[i]])];
+  }
+  int *b = &h->bucket[(k->hash / CACHE_SHARDS) & (h->buckets - 1)];
+  x->next = *b;
+  *b = e;
+  lru_push(h, e);
+  pthread_mutex_unlock(&h->lock);
+}
 
 /*
- * Main
- * ====
- *
- * Read one sudoku puzzle of 81 characters per line from stdin.
+ * Solve v's sudoku with v's engine, or from v's cache if it can.
+ */
+void solve_cached(solver *v)
+{
+  canon k;
+  if (cache_lookup(v->cache, v, &k))
+    return;
+  v->engine(v);
+  if (!v->count.aborted)
+    cache_store(v->cache, v, &k);
+}
+
+/*
+ * Retry Pass
+ * ==========
  *
- * Emit the first solution found to stderr.
+ * With --retry, a puzzle whose search was aborted is reported as such
+ * where it stands in the output, and also set aside.  Once all input
+ * has been read, the puzzles set aside are solved again without a
+ * budget, in input order, and their results follow everything else.
+ * The stream never waits on a hard puzzle, and still gets an answer
+ * for it at the end.
  */
 
-int main(int n, char **args) {
-  solver *v = new_solver(2);
-  reader* r = new_reader();
+typedef struct {
+  long   index;                 /* input line, from 0 */
+  size_t len;
+  char   text[SUDOKU_SIZE];
+} deferred;
 
-  while (read_sudoku(r, v)) {
-    if (!solve(v)) {
-      printf("%81s %8d %8d 0 0\n",
-             r->buf, v->count.choice, v->count.backtrack);
-    } else {
-      int n = array_length(v->solutions);
-      for (int i = 0; i < n; i++) {
-        sudoku s;
-        char t[SUDOKU_SIZE+1];
-        array_pop(v->solutions, &s);
-        sudoku_to_text(&s, t);
-        printf("%81s %8d %8d %1d %1d %81s\n",
-               r->buf, v->count.choice, v->count.backtrack,
-               i+1, n, t);
-      }
-    }
+struct retry {
+  pthread_mutex_t lock;         /* -j workers defer concurrently */
+  deferred *puzzles;
+  size_t    count, cap;
+};
+
+static struct retry *new_retry(void)
+{
+  struct retry *l = calloc(1, sizeof(struct retry));
+  pthread_mutex_init(&l->lock, NULL);
+  return l;
+}
+
+/* Set the puzzle in line index aside if v gave up on it. */
+static void defer_aborted(struct retry *l, solver const *v, long index,
+                          char const *text, size_t len)
+{
+  if (!l || !v->count.aborted)
+    return;
+  pthread_mutex_lock(&l->lock);
+  if (l->count == l->cap) {
+    l->cap = l->cap ? 2 * l->cap : 64;
+    l->puzzles = realloc(l->puzzles, l->cap * sizeof(deferred));
   }
+  deferred *d = &l->puzzles[l->count++];
+  d->index = index;
+  d->len = len;
+  memcpy(d->text, text, len);
+  pthread_mutex_unlock(&l->lock);
+}
+
+static int compare_deferred(void const *a, void const *b)
+{
+  long x = ((deferred const *)a)->index, y = ((deferred const *)b)->index;
+  return (x > y) - (x < y);
+}
+
+static void run_retries(struct retry *l, options const *o)
+{
+  options unlimited = *o;
+  unlimited.max_choices = 0;
+  unlimited.time_limit = 0;
+  unlimited.retry = NULL;
+  solver *v = new_solver(&unlimited);
+  writer *w = new_writer(stdout, WRITER_SIZE, o->format);
+  qsort(l->puzzles, l->count, sizeof(deferred), compare_deferred);
+  for (size_t i = 0; i < l->count; i++) {
+    deferred const *d = &l->puzzles[i];
+    sudoku_from_text(&v->sudoku, d->text, d->len);
+    clear_counts(v);
+    solve_cached(v);
+    print_solutions(w, d->text, d->len, v);
+  }
+  free_writer(w);
+  free_solver(v);
+}
+
+static void free_retry(struct retry *l)
+{
+  if (!l)
+    return;
+  pthread_mutex_destroy(&l->lock);
+  free(l->puzzles);
+  free(l);
+}
+
+/*
+ * Parallel Batch Mode
+ * ===================
+ *
+ * With -j N we solve puzzles on N worker threads, each of which owns
+ * its own solver.  The main thread reads puzzles into chunks of
+ * CHUNK_SIZE lines and hands them out round robin to the workers'
+ * deques.  A worker takes the oldest chunk from its own deque and,
+ * when that runs dry, steals the newest chunk from another worker's.
+ *
+ * Output is formatted by the worker into the chunk's own memory
+ * stream.  Finished chunks are parked in a reorder buffer and written
+ * strictly in input order, so the output is byte-for-byte what the
+ * single threaded loop would have produced.
+ *
+ * At most WINDOW_PER_WORKER * N chunks are in flight at any time.
+ * This bounds both memory and the size of the reorder buffer: the
+ * reader blocks until the oldest outstanding chunk has been written.
+ */
+
+#define CHUNK_SIZE        64
+#define WINDOW_PER_WORKER 4
+
+typedef struct {
+  size_t seq;                              /* position in input order */
+  int    length;                           /* number of lines used */
+  char const *line[CHUNK_SIZE];            /* puzzles as read */
+  size_t line_len[CHUNK_SIZE];
+  char   copy[CHUNK_SIZE][SUDOKU_SIZE];    /* line storage, if streaming */
+  writer *out;                             /* formatted results, */
+                                           /* reused chunk to chunk */
+} chunk;
+
+/*
+ * A deque holds the indexes (into the pool's chunks) of the chunks
+ * queued for one worker.  It never holds more than the window size,
+ * so a ring of that size suffices.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  size_t head;    /* oldest queued entry */
+  size_t tail;    /* one past the newest queued entry */
+  size_t *ring;
+} deque;
+
+typedef struct {
+  options const *options;
+  int     workers;
+  size_t  window;
+  chunk  *chunks;        /* window chunks, chunk seq lives at seq % window */
+  deque  *deques;        /* one per worker */
+
+  pthread_mutex_t lock;  /* protects everything below */
+  pthread_cond_t  work;  /* signalled when queued grows or done is set */
+  pthread_cond_t  space; /* signalled when written grows */
+  size_t  queued;        /* chunks in deques not yet claimed by a worker */
+  bool    done;          /* no more chunks will be queued */
+  bool    writing;       /* some worker is writing to stdout */
+  size_t  written;       /* chunks written so far (next seq to write) */
+  bool   *ready;         /* window flags: chunk finished, awaiting write */
+} pool;
+
+typedef struct {
+  pool *pool;
+  int   id;
+} worker;
+
+static void deque_push(deque *q, size_t window, size_t c)
+{
+  pthread_mutex_lock(&q->lock);
+  q->ring[q->tail++ % window] = c;
+  pthread_mutex_unlock(&q->lock);
+}
+
+/*
+ * The owner takes from the head (oldest first, which keeps the
+ * reorder buffer short); thieves take from the tail.
+ */
+static bool deque_take(deque *q, size_t window, bool steal, size_t *c)
+{
+  bool found = false;
+  pthread_mutex_lock(&q->lock);
+  if (q->head != q->tail) {
+    *c = steal ? q->ring[--q->tail % window] : q->ring[q->head++ % window];
+    found = true;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return found;
+}
+
+/*
+ * Write out every finished chunk at the front of the reorder buffer.
+ * Only one thread writes at a time; the lock is dropped while the
+ * actual I/O happens so other workers can keep submitting.
+ */
+static void pool_drain(pool *p)
+{
+  pthread_mutex_lock(&p->lock);
+  while (!p->writing && p->ready[p->written % p->window]) {
+    chunk *c = &p->chunks[p->written % p->window];
+    p->writing = true;
+    pthread_mutex_unlock(&p->lock);
+
+    c->out->stream = stdout;
+    writer_flush(c->out);
+    c->out->stream = NULL;
+
+    pthread_mutex_lock(&p->lock);
+    p->ready[p->written % p->window] = false;
+    p->written++;
+    p->writing = false;
+    pthread_cond_broadcast(&p->space);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void solve_chunk(options const *o, solver *v, chunk *c)
+{
+  for (int i = 0; i < c->length; i++) {
+    sudoku_from_text(&v->sudoku, c->line[i], c->line_len[i]);
+    clear_counts(v);
+    solve_cached(v);
+    defer_aborted(o->retry, v, c->seq * CHUNK_SIZE + i, c->line[i], c->line_len[i]);
+    print_solutions(c->out, c->line[i], c->line_len[i], v);
+  }
+}
+
+static void *worker_main(void *arg)
+{
+  worker *w = arg;
+  pool *p = w->pool;
+  solver *v = new_solver(p->options);
+
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    while (p->queued == 0 && !p->done)
+      pthread_cond_wait(&p->work, &p->lock);
+    if (p->queued == 0) {
+      pthread_mutex_unlock(&p->lock);
+      break;
+    }
+    p->queued--;
+    pthread_mutex_unlock(&p->lock);
+
+    /*
+     * Having decremented queued we are owed one chunk, but another
+     * worker may be holding the one we were counting on, so keep
+     * looking until we find it.
+     */
+    size_t ci;
+    for (int i = 0; ; i = (i + 1) % p->workers) {
+      int victim = (w->id + i) % p->workers;
+      if (deque_take(&p->deques[victim], p->window, i != 0, &ci))
+        break;
+    }
+
+    chunk *c = &p->chunks[ci];
+    solve_chunk(p->options, v, c);
+
+    pthread_mutex_lock(&p->lock);
+    p->ready[ci] = true;
+    pthread_mutex_unlock(&p->lock);
+    pool_drain(p);
+  }
+  free_solver(v);
+  return NULL;
+}
+
+static void solve_parallel(reader *r, options const *o, int workers)
+{
+  pool p;
+  p.options = o;
+  p.workers = workers;
+  p.window = (size_t)workers * WINDOW_PER_WORKER;
+  p.chunks = calloc(p.window, sizeof(chunk));
+  for (size_t i = 0; i < p.window; i++)
+    p.chunks[i].out = new_writer(NULL, CHUNK_SIZE * MAX_RECORD, o->format);
+  p.ready = calloc(p.window, sizeof(bool));
+  p.deques = calloc(workers, sizeof(deque));
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&p.deques[i].lock, NULL);
+    p.deques[i].ring = calloc(p.window, sizeof(size_t));
+  }
+  pthread_mutex_init(&p.lock, NULL);
+  pthread_cond_init(&p.work, NULL);
+  pthread_cond_init(&p.space, NULL);
+  p.queued = 0;
+  p.done = false;
+  p.writing = false;
+  p.written = 0;
+
+  worker *ws = calloc(workers, sizeof(worker));
+  pthread_t *ts = calloc(workers, sizeof(pthread_t));
+  for (int i = 0; i < workers; i++) {
+    ws[i].pool = &p;
+    ws[i].id = i;
+    pthread_create(&ts[i], NULL, worker_main, &ws[i]);
+  }
+
+  bool more = true;
+  for (size_t seq = 0; more; seq++) {
+    pthread_mutex_lock(&p.lock);
+    while (seq - p.written >= p.window)
+      pthread_cond_wait(&p.space, &p.lock);
+    pthread_mutex_unlock(&p.lock);
+
+    chunk *c = &p.chunks[seq % p.window];
+    c->seq = seq;
+    c->length = 0;
+    while (c->length < CHUNK_SIZE && (more = read_line(r))) {
+      int i = c->length++;
+      c->line_len[i] = r->line_len;
+      if (r->map && !r->packed) {
+        /* the mapping outlives the chunk, no need to copy */
+        c->line[i] = r->line;
+      } else {
+        memcpy(c->copy[i], r->line, r->line_len);
+        c->line[i] = c->copy[i];
+      }
+    }
+    if (c->length == 0)
+      break;
+
+    deque_push(&p.deques[seq % workers], p.window, seq % p.window);
+    pthread_mutex_lock(&p.lock);
+    p.queued++;
+    pthread_cond_signal(&p.work);
+    pthread_mutex_unlock(&p.lock);
+  }
+
+  pthread_mutex_lock(&p.lock);
+  p.done = true;
+  pthread_cond_broadcast(&p.work);
+  pthread_mutex_unlock(&p.lock);
+
+  for (int i = 0; i < workers; i++)
+    pthread_join(ts[i], NULL);
+  fflush(stdout);
+
+  for (size_t i = 0; i < p.window; i++)
+    free_writer(p.chunks[i].out);
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_destroy(&p.deques[i].lock);
+    free(p.deques[i].ring);
+  }
+  pthread_mutex_destroy(&p.lock);
+  pthread_cond_destroy(&p.work);
+  pthread_cond_destroy(&p.space);
+  free(ts);
+  free(ws);
+  free(p.deques);
+  free(p.ready);
+  free(p.chunks);
+}
+
+/*
+ * Lockstep Mode
+ * =============
+ *
+ * With -e lockstep the puzzles are read LOCKSTEP_BATCH at a time and
+ * solved in the lanes of lockstep.c, which refill from the batch as
+ * their puzzles finish.  The results are written in input order, and
+ * a puzzle that overflowed its lane is solved by solve() when its
+ * turn comes.  The output is what -e reference would write.
+ */
+
+#define LOCKSTEP_BATCH 4096
+
+static void solve_lockstep(reader *r, options const *o)
+{
+  lockstep *l = new_lockstep(o);
+  solver *v = new_solver(o);
+  writer *w = new_writer(stdout, WRITER_SIZE, o->format);
+  char const **line = malloc(LOCKSTEP_BATCH * sizeof(char const *));
+  size_t *len = malloc(LOCKSTEP_BATCH * sizeof(size_t));
+  char (*copy)[SUDOKU_SIZE] = malloc(LOCKSTEP_BATCH * SUDOKU_SIZE);
+  lockstep_result *results = malloc(LOCKSTEP_BATCH * sizeof(lockstep_result));
+
+  bool more = true;
+  for (long index = 0; more; ) {
+    size_t n = 0;
+    while (n < LOCKSTEP_BATCH && (more = read_line(r))) {
+      len[n] = r->line_len;
+      if (r->map && !r->packed) {
+        line[n] = r->line;
+      } else {
+        memcpy(copy[n], r->line, r->line_len);
+        line[n] = copy[n];
+      }
+      n++;
+    }
+    lockstep_solve(l, line, len, n, results);
+
+    for (size_t i = 0; i < n; i++, index++) {
+      lockstep_result const *x = &results[i];
+      if (x->overflow) {
+        sudoku_from_text(&v->sudoku, line[i], len[i]);
+        clear_counts(v);
+        v->engine(v);
+        defer_aborted(o->retry, v, index, line[i], len[i]);
+      } else {
+        clear_counts(v);
+        v->count.choice = x->choice;
+        v->count.backtrack = x->backtrack;
+        v->count.found = x->found;
+        for (int j = 0; j < x->kept; j++)
+          sudoku_stack_push(v->solutions, &x->solution[j]);
+      }
+      print_solutions(w, line[i], len[i], v);
+    }
+  }
+
+  free(results);
+  free(copy);
+  free(len);
+  free(line);
+  free_writer(w);
   free_solver(v);
+  free_lockstep(l);
+}
+
+/*
+ * Parallel Search
+ * ===============
+ *
+ * With -p N the search tree of each single puzzle is split across N
+ * threads, which pays off for the rare puzzles that need orders of
+ * magnitude more choices than the median.
+ *
+ * The tree is first expanded breadth first from the root, one level
+ * at a time, until the frontier holds at least SPLIT_FACTOR tasks
+ * per thread.  Expanding a level keeps the children of each node in
+ * ascending digit order, so the frontier lists the subtrees in the
+ * same order in which the sequential solve() would visit them.
+ *
+ * Threads then take tasks from the frontier in that order and solve
+ * each subtree with an ordinary solver.  Once the finished tasks up
+ * to some index already hold as many solutions as the caller asked
+ * for, nothing after that index can contribute, so those tasks are
+ * cancelled (or skipped if they have not started yet).  Collecting
+ * the solutions of the remaining tasks in order yields exactly the
+ * solutions the sequential search would have found.  Only the choice
+ * and backtrack counts differ, since subtrees that the sequential
+ * search would never have entered get partially explored.
+ */
+
+#define SPLIT_FACTOR 16
+
+typedef struct {
+  sudoku sudoku;  /* the subtree's root */
+  bool   cancel;  /* the result can no longer matter */
+  bool   done;    /* the subtree was searched to the end (or to cap) */
+  int    found;   /* solutions found, stored at search.found[index*cap] */
+} task;
+
+typedef struct {
+  int       threads;
+  size_t    cap;          /* solutions wanted per puzzle */
+  pthread_t *helpers;     /* threads - 1 helpers; the caller is the last */
+  solver   **solvers;     /* one per thread */
+
+  size_t    target;       /* frontier size at which splitting stops */
+  sudoku   *level[2];     /* scratch space for expanding the frontier */
+  task     *tasks;
+  size_t    ntasks;
+  sudoku   *found;        /* cap solutions per task */
+
+  pthread_mutex_t lock;   /* protects everything below */
+  pthread_cond_t  start;  /* signalled when a new puzzle is ready */
+  pthread_cond_t  finish; /* signalled when the last helper is done */
+  unsigned long   generation;
+  bool      quit;
+  int       running;      /* helpers still working on this puzzle */
+  size_t    next;         /* next task to hand out */
+  size_t    cutoff;       /* tasks past this index are not needed */
+  int       choice, backtrack;
+} search;
+
+/*
+ * Record the result of task i and move the cutoff forward if the
+ * finished prefix of the frontier now holds enough solutions.
+ * Called with the lock held.
+ */
+static void search_finish_task(search *s, size_t i, solver *w)
+{
+  task *t = &s->tasks[i];
+  size_t n = sudoku_stack_length(w->solutions);
+  t->found = n;
+  t->done = true;
+  /* solutions come off the stack newest first */
+  while (n > 0)
+    s->found[i * s->cap + --n] = *sudoku_stack_pop(w->solutions);
+
+  size_t sum = 0;
+  for (size_t j = 0; j < s->ntasks && j < s->cutoff; j++) {
+    if (s->tasks[j].done)
+      sum += s->tasks[j].found;
+    if (sum >= s->cap) {
+      for (size_t k = j + 1; k < s->ntasks && k <= s->cutoff; k++)
+        __atomic_store_n(&s->tasks[k].cancel, true, __ATOMIC_RELAXED);
+      s->cutoff = j;
+      break;
+    }
+  }
+}
+
+static void search_run_tasks(search *s, solver *w)
+{
+  for (;;) {
+    size_t i = __atomic_fetch_add(&s->next, 1, __ATOMIC_RELAXED);
+    if (i >= s->ntasks)
+      break;
+    task *t = &s->tasks[i];
+    if (__atomic_load_n(&t->cancel, __ATOMIC_RELAXED))
+      continue;
+
+    w->sudoku = t->sudoku;
+    w->cancel = &t->cancel;
+    clear_counts(w);
+    w->engine(w);
+
+    pthread_mutex_lock(&s->lock);
+    s->choice += w->count.choice;
+    s->backtrack += w->count.backtrack;
+    if (t->cancel) {
+      sudoku_stack_clear(w->solutions);
+    } else {
+      search_finish_task(s, i, w);
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+static void *search_helper(void *arg)
+{
+  search *s = ((void **)arg)[0];
+  solver *w = ((void **)arg)[1];
+  free(arg);
+  unsigned long seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&s->lock);
+    while (s->generation == seen && !s->quit)
+      pthread_cond_wait(&s->start, &s->lock);
+    if (s->quit) {
+      pthread_mutex_unlock(&s->lock);
+      break;
+    }
+    seen = s->generation;
+    pthread_mutex_unlock(&s->lock);
+
+    search_run_tasks(s, w);
+
+    pthread_mutex_lock(&s->lock);
+    if (--s->running == 0)
+      pthread_cond_signal(&s->finish);
+    pthread_mutex_unlock(&s->lock);
+  }
+  return NULL;
+}
+
+search *new_search(int threads, options const *o)
+{
+  search *s = calloc(1, sizeof(search));
+  size_t cap = o->max_sols;
+  s->threads = threads;
+  s->cap = cap;
+  s->target = (size_t)threads * SPLIT_FACTOR;
+  /* a level below target grows at most NUMBER_OF_DIGITS fold */
+  size_t room = s->target * NUMBER_OF_DIGITS;
+  s->level[0] = calloc(room, sizeof(sudoku));
+  s->level[1] = calloc(room, sizeof(sudoku));
+  s->tasks = calloc(room, sizeof(task));
+  s->found = calloc(room * cap, sizeof(sudoku));
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->start, NULL);
+  pthread_cond_init(&s->finish, NULL);
+
+  s->solvers = calloc(threads, sizeof(solver *));
+  s->helpers = calloc(threads - 1, sizeof(pthread_t));
+  for (int i = 0; i < threads; i++)
+    s->solvers[i] = new_solver(o);
+  for (int i = 0; i < threads - 1; i++) {
+    void **arg = malloc(2 * sizeof(void *));
+    arg[0] = s;
+    arg[1] = s->solvers[i + 1];
+    pthread_create(&s->helpers[i], NULL, search_helper, arg);
+  }
+  return s;
+}
+
+search *free_search(search *s)
+{
+  if (s) {
+    pthread_mutex_lock(&s->lock);
+    s->quit = true;
+    pthread_cond_broadcast(&s->start);
+    pthread_mutex_unlock(&s->lock);
+    for (int i = 0; i < s->threads - 1; i++)
+      pthread_join(s->helpers[i], NULL);
+    for (int i = 0; i < s->threads; i++)
+      free_solver(s->solvers[i]);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->start);
+    pthread_cond_destroy(&s->finish);
+    free(s->solvers);
+    free(s->helpers);
+    free(s->found);
+    free(s->tasks);
+    free(s->level[0]);
+    free(s->level[1]);
+    free(s);
+  }
+  return NULL;
+}
+
+/*
+ * Expand the frontier from v->sudoku into s->tasks.  The expansion
+ * is counted against v just as solve() would count it.
+ */
+static void search_split(search *s, solver *v)
+{
+  sudoku *cur = s->level[0], *nxt = s->level[1];
+  size_t n = 1;
+  cur[0] = v->sudoku;
+
+  while (n < s->target) {
+    size_t m = 0;
+    bool expanded = false;
+    for (size_t i = 0; i < n; i++) {
+      v->count.choice++;
+      if (!propagate(&cur[i], v->level, NULL)) {
+        v->count.backtrack++;
+        continue;
+      }
+      v->sudoku = cur[i];
+      pos p = choose_move(v);
+      digit_set dsp = cur[i].free[p];
+      switch (SET_SIZE(dsp)) {
+      case 0:
+        v->count.backtrack++;
+        break;
+      case 1:
+        nxt[m++] = cur[i];
+        break;
+      default: {
+        /* the digits in the order solve() tries them */
+        digit order[NUMBER_OF_DIGITS];
+        int k = order_digits(v, p, dsp, order);
+        for (int j = 0; j < k; j++) {
+          nxt[m] = cur[i];
+          if (claim(&nxt[m], p, order[j], NULL))
+            m++;
+          else
+            v->count.backtrack++;
+        }
+        expanded = true;
+      }
+      }
+    }
+    sudoku *tmp = cur; cur = nxt; nxt = tmp;
+    n = m;
+    if (!expanded)
+      break;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    s->tasks[i].sudoku = cur[i];
+    s->tasks[i].cancel = false;
+    s->tasks[i].done = false;
+    s->tasks[i].found = 0;
+  }
+  s->ntasks = n;
+}
+
+/*
+ * Solve v->sudoku using all of s's threads, leaving the solutions
+ * in v->solutions and the counts in v->count as solve() would.
+ */
+bool solve_split(search *s, solver *v)
+{
+  search_split(s, v);
+
+  pthread_mutex_lock(&s->lock);
+  s->next = 0;
+  s->cutoff = s->ntasks;
+  s->choice = s->backtrack = 0;
+  s->running = s->threads - 1;
+  s->generation++;
+  pthread_cond_broadcast(&s->start);
+  pthread_mutex_unlock(&s->lock);
+
+  search_run_tasks(s, s->solvers[0]);
+
+  pthread_mutex_lock(&s->lock);
+  while (s->running > 0)
+    pthread_cond_wait(&s->finish, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+
+  v->count.choice += s->choice;
+  v->count.backtrack += s->backtrack;
+  for (size_t i = 0; i < s->ntasks && i <= s->cutoff; i++)
+    for (int k = 0; k < s->tasks[i].found; k++)
+      if (sudoku_stack_length(v->solutions) < sudoku_stack_capacity(v->solutions))
+        sudoku_stack_push(v->solutions, &s->found[i * s->cap + k]);
+  v->count.found = sudoku_stack_length(v->solutions);
+  return sudoku_stack_length(v->solutions) > 0;
+}
+
+/*
+ * Benchmark
+ * =========
+ *
+ * With -B every file named on the command line is solved on one
+ * thread, over and over until at least BENCH_SECONDS have passed,
+ * timing each puzzle.  With --branch=all each file is solved so with
+ * every combination of branching heuristics in turn.  A summary goes
+ * to stderr and the full results to stdout as JSON:
+ *
+ *   {"engine": "reference", "level": 1, "files": [
+ *     {"file": "puzzles/x00", "branch": "mrv,ascending",
+ *      "puzzles": 30000, "rounds": 3,
+ *      "seconds": 0.93, "puzzles_per_sec": 32258.1,
+ *      "mean_choices": 6.2, "mean_backtracks": 1.4,
+ *      "latency_ns": {"p50": 21000, "p99": 160000, ...},
+ *      "choice_histogram": [[0, 1200], [1, 800], [2, 950], ...],
+ *      "backtrack_histogram": [...]}, ...]}
+ *
+ * A histogram entry [b, n] counts the n puzzles whose count was b
+ * or more but less than 2b (or exactly 0 for b = 0).
+ *
+ * With -C the results are compared with those saved from an earlier
+ * run, and any file (and heuristic) that got more than BENCH_TOLERANCE
+ * slower in throughput or 99th percentile latency is flagged as a
+ * regression.
+ */
+
+#define BENCH_SECONDS   1.0
+#define BENCH_TOLERANCE 0.10
+#define BENCH_BUCKETS   33
+
+typedef struct {
+  char const *file;
+  char const *branch;    /* the heuristics, as --branch names them */
+  size_t      puzzles;
+  int         rounds;
+  double      seconds;
+  uint64_t   *latency;   /* one per puzzle solved, in ns */
+  size_t      cap;
+  uint64_t    choices, backtracks;
+  size_t      choice[BENCH_BUCKETS];
+  size_t      backtrack[BENCH_BUCKETS];
+} bench;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bucket(int n)
+{
+  return (n <= 0) ? 0 : 32 - __builtin_clz(n);
+}
+
+static int compare_u64(void const *a, void const *b)
+{
+  uint64_t x = *(uint64_t const *)a, y = *(uint64_t const *)b;
+  return (x > y) - (x < y);
+}
+
+/* The nearest rank q-quantile of the sorted latencies. */
+static uint64_t percentile(bench const *b, double q)
+{
+  size_t rank = (size_t)(q * b->puzzles + 0.999999);
+  return b->latency[rank ? rank - 1 : 0];
+}
+
+static bool bench_file(bench *b, solver *v)
+{
+  uint64_t start = now_ns(), elapsed = 0;
+  do {
+    reader *r = new_reader(b->file);
+    if (!r)
+      return false;
+    while (read_line(r)) {
+      uint64_t t = now_ns();
+      sudoku_from_text(&v->sudoku, r->line, r->line_len);
+      clear_counts(v);
+      v->engine(v);
+      t = now_ns() - t;
+
+      if (b->puzzles == b->cap) {
+        b->cap = b->cap ? 2 * b->cap : 1024;
+        b->latency = realloc(b->latency, b->cap * sizeof(uint64_t));
+      }
+      b->latency[b->puzzles++] = t;
+      b->choices += v->count.choice;
+      b->backtracks += v->count.backtrack;
+      b->choice[bucket(v->count.choice)]++;
+      b->backtrack[bucket(v->count.backtrack)]++;
+      sudoku_stack_clear(v->solutions);
+    }
+    free_reader(r);
+    b->rounds++;
+    elapsed = now_ns() - start;
+  } while (elapsed < BENCH_SECONDS * 1e9 && b->puzzles > 0);
+  b->seconds = elapsed / 1e9;
+  qsort(b->latency, b->puzzles, sizeof(uint64_t), compare_u64);
+  return true;
+}
+
+static void print_histogram(char const *name, size_t const *h)
+{
+  int last = BENCH_BUCKETS - 1;
+  while (last > 0 && h[last] == 0)
+    last--;
+  printf(",\n     \"%s\": [", name);
+  for (int i = 0; i <= last; i++)
+    printf("%s[%" PRIu64 ", %zu]", i ? ", " : "", i ? (uint64_t)1 << (i - 1) : 0, h[i]);
+  printf("]");
+}
+
+static void print_bench(bench const *b, bool first)
+{
+  printf("%s    {\"file\": \"%s\", \"branch\": \"%s\",\n"
+         "     \"puzzles\": %zu, \"rounds\": %d,\n"
+         "     \"seconds\": %.6f, \"puzzles_per_sec\": %.1f,\n"
+         "     \"mean_choices\": %.2f, \"mean_backtracks\": %.2f,\n"
+         "     \"latency_ns\": {\"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", "
+         "\"p999\": %" PRIu64 ", \"max\": %" PRIu64 "}",
+         first ? "" : ",\n", b->file, b->branch, b->puzzles, b->rounds, b->seconds,
+         b->puzzles / b->seconds, (double)b->choices / b->puzzles,
+         (double)b->backtracks / b->puzzles,
+         percentile(b, 0.5), percentile(b, 0.99), percentile(b, 0.999),
+         b->latency[b->puzzles - 1]);
+  print_histogram("choice_histogram", b->choice);
+  print_histogram("backtrack_histogram", b->backtrack);
+  printf("}");
+}
+
+/*
+ * Find the number following "key": in the entry for file and branch
+ * in the baseline JSON, as written by print_bench.
+ */
+static bool baseline_value(char const *json, bench const *b, char const *key,
+                           double *value)
+{
+  char pattern[512];
+  snprintf(pattern, sizeof(pattern), "{\"file\": \"%s\", \"branch\": \"%s\"",
+           b->file, b->branch);
+  char const *entry = strstr(json, pattern);
+  if (!entry)
+    return false;
+  char const *end = strstr(entry + 1, "{\"file\": ");
+  snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+  char const *p = strstr(entry, pattern);
+  if (!p || (end && p > end))
+    return false;
+  *value = strtod(p + strlen(pattern), NULL);
+  return true;
+}
+
+static char *read_file(char const *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return NULL;
+  char *buf = NULL;
+  size_t len = 0;
+  ssize_t n = getdelim(&buf, &len, '\0', f);
+  fclose(f);
+  if (n < 0) {
+    free(buf);
+    return NULL;
+  }
+  return buf;
+}
+
+/*
+ * Report how b compares with the baseline.  Returns false if it
+ * regressed.
+ */
+static bool compare_bench(bench const *b, char const *baseline)
+{
+  double rate, p99;
+  if (!baseline_value(baseline, b, "puzzles_per_sec", &rate) ||
+      !baseline_value(baseline, b, "p99", &p99)) {
+    fprintf(stderr, "%-32s not in baseline\n", "");
+    return true;
+  }
+  double rate_ratio = (b->puzzles / b->seconds) / rate;
+  double p99_ratio = percentile(b, 0.99) / p99;
+  bool ok = rate_ratio >= 1 - BENCH_TOLERANCE && p99_ratio <= 1 + BENCH_TOLERANCE;
+  fprintf(stderr, "%-32s %.2fx puzzles/s, %.2fx p99 vs baseline%s\n", "",
+          rate_ratio, p99_ratio, ok ? "" : "  REGRESSION");
+  return ok;
+}
+
+/*
+ * The branching heuristics (see solver.c) by name, for --branch and
+ * the benchmark.  A combination is named "variable,value".
+ */
+static char const *const variable_names[] = {
+  [MRV]                   = "mrv",
+  [MRV_DEGREE]            = "degree",
+  [MOST_CONSTRAINED_UNIT] = "unit",
+};
+
+static char const *const value_names[] = {
+  [ASCENDING]          = "ascending",
+  [LEAST_CONSTRAINING] = "lcv",
+};
+
+#define NUM_VARIABLE_ORDERS (sizeof(variable_names) / sizeof(variable_names[0]))
+#define NUM_VALUE_ORDERS    (sizeof(value_names) / sizeof(value_names[0]))
+#define MAX_BRANCH_NAME     32
+
+static void branch_name(options const *o, char *name)
+{
+  snprintf(name, MAX_BRANCH_NAME, "%s,%s", variable_names[o->variable],
+           value_names[o->value]);
+}
+
+/* Set o's heuristics from "variable[,value]".  Returns false if unknown. */
+static bool parse_branch(char const *arg, options *o)
+{
+  size_t len = strcspn(arg, ",");
+  bool found = false;
+  for (size_t i = 0; i < NUM_VARIABLE_ORDERS; i++)
+    if (strlen(variable_names[i]) == len && strncmp(arg, variable_names[i], len) == 0) {
+      o->variable = i;
+      found = true;
+    }
+  if (!found || arg[len] == '\0')
+    return found;
+  for (size_t i = 0; i < NUM_VALUE_ORDERS; i++)
+    if (strcmp(arg + len + 1, value_names[i]) == 0) {
+      o->value = i;
+      return true;
+    }
+  return false;
+}
+
+static int run_bench(char **files, int n, options const *o, char const *engine_name,
+                     char const *baseline_path, bool all_branches)
+{
+  char *baseline = NULL;
+  if (baseline_path && !(baseline = read_file(baseline_path)))
+    perror(baseline_path);
+
+  int branches = all_branches ? NUM_VARIABLE_ORDERS * NUM_VALUE_ORDERS : 1;
+  bool ok = true, first = true;
+  printf("{\"engine\": \"%s\", \"level\": %d, \"files\": [\n", engine_name, o->level);
+  for (int i = 0; i < n; i++) {
+    for (int k = 0; k < branches; k++) {
+      options bo = *o;
+      if (all_branches) {
+        bo.variable = k / NUM_VALUE_ORDERS;
+        bo.value = k % NUM_VALUE_ORDERS;
+      }
+      char name[MAX_BRANCH_NAME];
+      branch_name(&bo, name);
+      solver *v = new_solver(&bo);
+      bench b = { .file = files[i], .branch = name };
+      bool read = bench_file(&b, v);
+      free_solver(v);
+      if (!read) {
+        perror(files[i]);
+        ok = false;
+        break;
+      }
+      if (b.puzzles == 0)
+        break;
+      fprintf(stderr, "%-32s %-16s %8zu puzzles %10.1f/s %9.1f choices  "
+              "p50 %" PRIu64 " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 " ns\n",
+              b.file, b.branch, b.puzzles, b.puzzles / b.seconds,
+              (double)b.choices / b.puzzles, percentile(&b, 0.5),
+              percentile(&b, 0.99), percentile(&b, 0.999), b.latency[b.puzzles - 1]);
+      if (baseline)
+        ok = compare_bench(&b, baseline) && ok;
+      print_bench(&b, first);
+      first = false;
+      free(b.latency);
+    }
+  }
+  printf("\n]}\n");
+  free(baseline);
+  return ok ? 0 : 1;
+}
+
+/*
+ * Generator
+ * =========
+ *
+ * With --generate=N the solver makes N minimal puzzles with a unique
+ * solution instead of solving any, on as many threads as -j says.
+ *
+ * Each puzzle starts from a random solution grid: a few random
+ * digits are placed in random open positions and the search fills
+ * in the rest, after which the digits are relabeled at random.  Then
+ * the clues are taken away one at a time in random order, each put
+ * back if the puzzle no longer has a unique solution.  A clue that
+ * can't be taken away can't be taken away later either, when there
+ * are fewer clues left, so one pass leaves a minimal puzzle.
+ *
+ * Puzzle i draws its random numbers from its own stream, seeded from
+ * --seed and i, so the same seed gives the same puzzles whatever the
+ * number of threads.  Threads take blocks of GEN_BLOCK puzzles in
+ * turn and park them in a reorder buffer, as in Parallel Batch Mode,
+ * which writes them in order: the output is the same for any -j.  At
+ * most GEN_WINDOW blocks per thread are in flight.
+ *
+ * Uniqueness checks on puzzles with few clues are slow without hidden
+ * singles, so the generator propagates at least those unless -l says
+ * otherwise.
+ */
+
+#define GEN_SEEDS 11   /* random digits placed before the search */
+#define GEN_BLOCK 64   /* puzzles a thread takes at a time */
+#define GEN_WINDOW 4   /* blocks in flight per thread */
+
+/*
+ * xoshiro256** seeded through splitmix64.
+ */
+typedef struct {
+  uint64_t s[4];
+} rng;
+
+static uint64_t splitmix64(uint64_t *x)
+{
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static void rng_seed(rng *r, uint64_t seed, uint64_t stream)
+{
+  uint64_t x = seed ^ splitmix64(&stream);
+  for (int i = 0; i < 4; i++)
+    r->s[i] = splitmix64(&x);
+}
+
+static uint64_t rng_next(rng *r)
+{
+  uint64_t *s = r->s;
+  uint64_t result = s[1] * 5;
+  result = ((result << 7) | (result >> 57)) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = (s[3] << 45) | (s[3] >> 19);
+  return result;
+}
+
+/* A random number in [0, n). */
+static int rng_below(rng *r, int n)
+{
+  return ((rng_next(r) >> 32) * n) >> 32;
+}
+
+typedef struct {
+  options const *options;
+  uint64_t seed;
+  long     count;          /* puzzles to make */
+  long     window;         /* blocks in flight, at most */
+  writer **out;            /* block b is formatted into out[b % window] */
+
+  pthread_mutex_t lock;    /* protects everything below */
+  pthread_cond_t  space;   /* signalled when written grows */
+  long     next;           /* next puzzle to hand out */
+  long     clues;          /* clues in all puzzles made */
+  long     written;        /* blocks written so far */
+  bool    *ready;          /* window flags: block made, awaiting write */
+} generator;
+
+/*
+ * Make a random solution grid in fill's sudoku.
+ */
+static void random_grid(solver *fill, rng *r)
+{
+  for (;;) {
+    sudoku *s = &fill->sudoku;
+    sudoku_from_text(s, "", 0);
+    bool ok = true;
+    for (int k = 0; k < GEN_SEEDS && ok; k++) {
+      pos p = rng_below(r, SUDOKU_SIZE);
+      if (SET_SIZE(s->free[p]) < 2)
+        continue;
+      digit d;
+      do
+        d = MIN_DIGIT + rng_below(r, NUMBER_OF_DIGITS);
+      while (!IN_SET(s->free[p], d));
+      ok = claim(s, p, d, NULL);
+    }
+    clear_counts(fill);
+    if (ok && fill->engine(fill)) {
+      *s = *sudoku_stack_pop(fill->solutions);
+      return;
+    }
+    sudoku_stack_clear(fill->solutions);
+  }
+}
+
+/* Whether the puzzle in text has exactly one solution. */
+static bool unique(solver *check, char const *text)
+{
+  sudoku_from_text(&check->sudoku, text, SUDOKU_SIZE);
+  clear_counts(check);
+  check->engine(check);
+  return check->count.found == 1;
+}
+
+/*
+ * Make puzzle i into text, returning the number of clues.
+ */
+static int generate(generator *g, long i, solver *fill, solver *check, char *text)
+{
+  rng r;
+  rng_seed(&r, g->seed, i);
+  random_grid(fill, &r);
+
+  digit label[NUMBER_OF_DIGITS];
+  for (int d = 0; d < NUMBER_OF_DIGITS; d++)
+    label[d] = MIN_DIGIT + d;
+  for (int d = NUMBER_OF_DIGITS - 1; d > 0; d--) {
+    int e = rng_below(&r, d + 1);
+    digit t = label[d]; label[d] = label[e]; label[e] = t;
+  }
+  for (int p = 0; p < SUDOKU_SIZE; p++)
+    text[p] = DIGIT_TO_CHAR(label[__builtin_ctz(fill->sudoku.free[p]) - MIN_DIGIT]);
+
+  pos order[SUDOKU_SIZE];
+  for (int p = 0; p < SUDOKU_SIZE; p++) {
+    int q = rng_below(&r, p + 1);
+    order[p] = order[q];
+    order[q] = p;
+  }
+  int clues = SUDOKU_SIZE;
+  for (int k = 0; k < SUDOKU_SIZE; k++) {
+    char c = text[order[k]];
+    text[order[k]] = '.';
+    if (unique(check, text))
+      clues--;
+    else
+      text[order[k]] = c;
+  }
+  return clues;
+}
+
+static void *generator_main(void *arg)
+{
+  generator *g = arg;
+  options fill_options = *g->options, check_options = *g->options;
+  fill_options.max_sols = fill_options.limit = 1;
+  check_options.max_sols = 0;
+  check_options.limit = 2;
+  solver *fill = new_solver(&fill_options);
+  solver *check = new_solver(&check_options);
+
+  for (;;) {
+    pthread_mutex_lock(&g->lock);
+    while (g->next < g->count && g->next / GEN_BLOCK - g->written >= g->window)
+      pthread_cond_wait(&g->space, &g->lock);
+    long start = g->next;
+    if (start < g->count)
+      g->next += GEN_BLOCK;
+    pthread_mutex_unlock(&g->lock);
+    if (start >= g->count)
+      break;
+
+    long block = start / GEN_BLOCK;
+    long end = (start + GEN_BLOCK < g->count) ? start + GEN_BLOCK : g->count;
+    writer *out = g->out[block % g->window];
+    long clues = 0;
+    for (long i = start; i < end; i++) {
+      char *t = writer_reserve(out);
+      clues += generate(g, i, fill, check, t);
+      t[SUDOKU_SIZE] = '\n';
+      out->len += SUDOKU_SIZE + 1;
+    }
+
+    /* write out every block made at the front of the buffer */
+    pthread_mutex_lock(&g->lock);
+    g->clues += clues;
+    g->ready[block % g->window] = true;
+    while (g->ready[g->written % g->window]) {
+      out = g->out[g->written % g->window];
+      out->stream = stdout;
+      writer_flush(out);
+      out->stream = NULL;
+      g->ready[g->written % g->window] = false;
+      g->written++;
+    }
+    pthread_cond_broadcast(&g->space);
+    pthread_mutex_unlock(&g->lock);
+  }
+
+  free_solver(check);
+  free_solver(fill);
+  return NULL;
+}
+
+/*
+ * Write count minimal puzzles to stdout, reporting the rate on
+ * stderr.
+ */
+static void run_generator(long count, uint64_t seed, options const *o, int threads)
+{
+  generator g = { .options = o, .seed = seed, .count = count };
+  g.window = GEN_WINDOW * threads;
+  g.out = calloc(g.window, sizeof(writer *));
+  g.ready = calloc(g.window, sizeof(bool));
+  for (long b = 0; b < g.window; b++)
+    g.out[b] = new_writer(NULL, GEN_BLOCK * (SUDOKU_SIZE + 1), TEXT_RESULTS);
+  pthread_mutex_init(&g.lock, NULL);
+  pthread_cond_init(&g.space, NULL);
+  uint64_t start = now_ns();
+
+  pthread_t *ts = calloc(threads, sizeof(pthread_t));
+  for (int i = 0; i < threads; i++)
+    pthread_create(&ts[i], NULL, generator_main, &g);
+  for (int i = 0; i < threads; i++)
+    pthread_join(ts[i], NULL);
+  fflush(stdout);
+
+  double seconds = (now_ns() - start) / 1e9;
+  fprintf(stderr, "generated %ld minimal puzzles in %.3f s, %.1f/s, %.2f clues on average (seed %" PRIu64 ")\n",
+          count, seconds, count / seconds, (double)g.clues / count, seed);
+  free(ts);
+  for (long b = 0; b < g.window; b++)
+    free_writer(g.out[b]);
+  free(g.out);
+  free(g.ready);
+  pthread_mutex_destroy(&g.lock);
+  pthread_cond_destroy(&g.space);
+}
+
+/*
+ * Statistics
+ * ==========
+ *
+ * In a build with STATS (make STATS=1), --stats=FILE writes a JSON
+ * line per puzzle to FILE: the counts of the search and of its
+ * propagation (see Statistics in solver.c), the time it took, and
+ * where perf_event_open() allows the cycles, branch misses and level
+ * 1 data cache misses the processor counted.  Only the reference and
+ * trail engines are probed.  Without STATS the probes are empty and
+ * --stats is refused.
+ */
+
+#ifdef STATS
+
+static FILE *stats_file;
+static bool have_counters;
+
+typedef struct {
+  uint64_t start;
+  counters hw;
+} probe;
+
+static bool stats_open(char const *path)
+{
+  stats_file = fopen(path, "w");
+  if (!stats_file) {
+    perror(path);
+    return false;
+  }
+  have_counters = counters_open();
+  if (!have_counters)
+    fprintf(stderr, "stats: no hardware counters\n");
+  return true;
+}
+
+static void probe_start(probe *p)
+{
+  if (!stats_file)
+    return;
+  memset(thread_stats(), 0, sizeof(stats));
+  counters_read(&p->hw);
+  p->start = now_ns();
+}
+
+static void probe_stop(probe *p, solver const *v, long index)
+{
+  if (!stats_file)
+    return;
+  uint64_t ns = now_ns() - p->start;
+  counters hw;
+  counters_read(&hw);
+  stats const *s = thread_stats();
+  fprintf(stats_file,
+          "{\"puzzle\": %ld, \"solutions\": %ld, \"choices\": %d, \"backtracks\": %d, "
+          "\"revokes\": %ld, \"eliminations\": %ld, \"max_queue\": %d, \"max_depth\": %d, "
+          "\"ns\": %" PRIu64 ", \"next_move_ticks\": %" PRIu64 ", "
+          "\"propagate_ticks\": %" PRIu64 ", \"copy_ticks\": %" PRIu64,
+          index, v->count.found, v->count.choice, v->count.backtrack,
+          s->revokes, s->eliminations, s->max_queue, s->max_depth,
+          ns, s->next_move_ticks, s->propagate_ticks, s->copy_ticks);
+  if (have_counters)
+    fprintf(stats_file,
+            ", \"cycles\": %" PRIu64 ", \"branch_misses\": %" PRIu64
+            ", \"l1d_misses\": %" PRIu64,
+            hw.cycles - p->hw.cycles, hw.branch_misses - p->hw.branch_misses,
+            hw.l1d_misses - p->hw.l1d_misses);
+  fputs("}\n", stats_file);
+}
+
+static void stats_close(void)
+{
+  if (stats_file)
+    fclose(stats_file);
+}
+
+#else
+
+typedef int probe;
+
+static bool stats_open(char const *path)
+{
+  fprintf(stderr, "--stats needs a build with make STATS=1\n");
+  return false;
+}
+
+static inline void probe_start(probe *p) {}
+static inline void probe_stop(probe *p, solver const *v, long index) {}
+static inline void stats_close(void) {}
+
+#endif
+
+/*
+ * Larger Boards
+ * =============
+ *
+ * With --size=16 or --size=25 the puzzles are read (as lines of 256
+ * or 625 characters) and solved with the solvers in board.c, one at a
+ * time.  The lines printed are those of 9x9 puzzles with the puzzle
+ * and solution as wide as the board.
+ */
+
+static void print_board(writer *w, board_job const *j, size_t cells)
+{
+  size_t i = j->kept;
+  do {
+    char *t = writer_room(w, 2 * cells + MAX_RECORD);
+    t = put_padded(t, j->text, j->len, cells);
+    t = put_counts(t, j->choice, j->backtrack, i ? j->kept - i + 1 : 0, j->found);
+    if (i) {
+      /* newest first, as 9x9 solutions come off their stack */
+      *t++ = ' ';
+      memcpy(t, j->solutions + --i * cells, cells);
+      t += cells;
+    }
+    *t++ = '\n';
+    w->len = t - w->buf;
+  } while (i);
+}
+
+static int run_boards(reader *r, options const *o, int side)
+{
+  void (*solve_board)(board_job *) = (side == 16) ? solve_board16 : solve_board25;
+  size_t cells = side * side;
+  if (r->packed) {
+    fprintf(stderr, "packed puzzles are 9x9\n");
+    return 1;
+  }
+  r->cells = cells;
+  char *solutions = malloc(o->max_sols * cells + 1);
+  writer *w = new_writer(stdout, WRITER_SIZE, TEXT_RESULTS);
+  while (read_line(r)) {
+    board_job j = {
+      .text = r->line, .len = r->line_len, .level = o->level,
+      .limit = o->limit, .max_sols = o->max_sols, .solutions = solutions
+    };
+    solve_board(&j);
+    print_board(w, &j, cells);
+  }
+  free_writer(w);
+  free(solutions);
+  return 0;
+}
+
+/*
+ * Verifying Solutions
+ * ===================
+ *
+ * With --verify the files named (or stdin) are read as results, as
+ * the writer prints them, and each solution is checked in batches
+ * (see verify.c): a valid grid that keeps the givens.  The puzzle is
+ * the first 81 characters of a line and the solution the last 81, so
+ * results from elsewhere need only keep to that.  Lines too short to
+ * hold both, such as those with no solution, are counted in the
+ * summary but not checked.  Bad lines are reported on stdout and a
+ * summary on stderr.
+ */
+
+/*
+ * Check the solutions in b, from the given lines of path.  Returns
+ * how many were bad.
+ */
+static long verify_lines(verify_batch *b, long const *lines, char const *path)
+{
+  verify_status status[VERIFY_BATCH];
+  int n = verify_run(b, status);
+  long bad = 0;
+  for (int i = 0; i < n; i++) {
+    if (status[i] != VERIFY_OK) {
+      bad++;
+      printf("%s:%ld: %s\n", path, lines[i],
+             status[i] == VERIFY_INVALID ? "invalid grid" : "givens changed");
+    }
+  }
+  return bad;
+}
+
+static int run_verify(char **paths, int n)
+{
+  static verify_batch b; /* zeros after the text, see verify.h */
+  long lines[VERIFY_BATCH];
+  long checked = 0, bad = 0, unsolved = 0;
+  size_t bytes = 0;
+  int status = 0;
+  uint64_t start = now_ns();
+  for (int i = 0; i < (n ? n : 1); i++) {
+    char const *path = n ? paths[i] : "stdin";
+    reader *r = new_reader(n ? path : NULL);
+    if (!r) {
+      perror(path);
+      status = 1;
+      continue;
+    }
+    if (r->packed) {
+      fprintf(stderr, "%s: packed puzzles have no solutions\n", path);
+      free_reader(r);
+      status = 1;
+      continue;
+    }
+    r->cells = SIZE_MAX;
+    for (long line = 1; read_line(r); line++) {
+      bytes += r->line_len + 1;
+      if (r->line_len < 2 * SUDOKU_SIZE + 1) {
+        unsolved++;
+        continue;
+      }
+      char const *puzzle = r->line;
+      char const *solution = r->line + r->line_len - SUDOKU_SIZE;
+      char text[SUDOKU_SIZE];
+      if (puzzle[0] == ' ') {
+        /* a shorter puzzle, right aligned */
+        size_t pad = strspn(puzzle, " ");
+        if (pad > SUDOKU_SIZE)
+          pad = SUDOKU_SIZE;
+        memset(text, '.', SUDOKU_SIZE);
+        memcpy(text, puzzle + pad, SUDOKU_SIZE - pad);
+        puzzle = text;
+      }
+      checked++;
+      lines[b.count] = line;
+      if (verify_add(&b, puzzle, solution))
+        bad += verify_lines(&b, lines, path);
+    }
+    bad += verify_lines(&b, lines, path);
+    free_reader(r);
+  }
+  double seconds = (now_ns() - start) / 1e9;
+  fprintf(stderr, "%ld solutions checked, %ld bad, %ld lines without a solution, %.1f MB/s\n",
+          checked, bad, unsolved, bytes / seconds / 1e6);
+  return (bad || status) ? 1 : 0;
+}
+
+/*
+ * Main
+ * ====
+ *
+ * Read one sudoku puzzle of 81 characters per line from the file
+ * named on the command line, or from stdin.
+ *
+ * Emit the solutions found to stdout.
+ *
+ * Options:
+ *   -j N   solve on N worker threads (default 1)
+ *   -p N   split the search for each puzzle across N threads (the
+ *          reference and trail engines only)
+ *   -l N   propagation level: 0 naked singles (default), 1 hidden
+ *          singles, 2 locked candidates
+ *   -e E   search engine: reference (default), trail, bitboard, dlx
+ *          or lockstep (see Lockstep Mode)
+ *   -b     write packed results
+ *   -c N   cache the solutions of up to N puzzles (see Solution Cache)
+ *   --count[=LIMIT]
+ *          count the solutions, up to LIMIT if given, instead of
+ *          printing the first two
+ *   --first
+ *          with --count, print the first solution as well
+ *   --generate=N
+ *          make N minimal puzzles instead (see Generator)
+ *   --seed=S
+ *          seed the generator's random numbers
+ *   --grade
+ *          grade the puzzles instead of solving them (see Grader)
+ *   -B     benchmark the files named (see Benchmark) instead
+ *   -C F   compare the benchmark with the baseline saved in F
+ */
+
+static const struct {
+  char const *name;
+  engine engine;
+} engines[] = {
+  { "reference", solve },
+  { "trail",     solve_trail },
+  { "bitboard",  solve_bitboard },
+  { "dlx",       solve_dlx },
+  { "lockstep",  solve },     /* in lanes, overflowing to solve() */
+};
+
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static void usage(char const *prog)
+{
+  fprintf(stderr, "usage: %s [-j workers | -p threads] [-l level] [-e engine] [-c entries] [-b]\n"
+          "       %*s [--count[=limit] [--first] | --grade] [--stats=file]\n"
+          "       %*s [--max-choices=n] [--timeout=ms] [--retry] [--branch=var,val]\n"
+          "       %*s [puzzles]\n"
+          "       %s --size=16|25 [-l level] [--count[=limit] [--first]] [puzzles]\n"
+          "       %s --generate=count [--seed=seed] [-j threads] [-l level] [-e engine]\n"
+          "       %s -B [-C baseline] [-l level] [-e engine] [--branch=var,val|all]\n"
+          "       %*s puzzles...\n"
+          "       %s --verify [results...]\n"
+          "       %s --serve=socket [-j workers] [-l level] [-e engine]\n"
+          "       %*s [--max-choices=n] [--timeout=ms]\n",
+          prog, (int)strlen(prog), "", (int)strlen(prog), "", (int)strlen(prog), "",
+          prog, prog, prog, (int)strlen(prog), "", prog, prog, (int)strlen(prog), "");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int workers = 1;
+  int threads = 1;
+  options o = { .max_sols = 2, .limit = 2, .level = NAKED_SINGLES, .engine = solve };
+  char const *engine_name = engines[0].name;
+  bool benchmark = false;
+  bool counting = false, first = false;
+  bool level_set = false;
+  bool grading = false;
+  bool engine_set = false;
+  sudoku_engine engine = SUDOKU_REFERENCE;
+  int side = 9;
+  long generate = 0;
+  uint64_t seed = time(NULL);
+  size_t cache_size = 0;
+  char const *baseline = NULL;
+  char const *stats_path = NULL;
+  char const *serve_path = NULL;
+  long timeout_ms = 0;
+  bool retry = false;
+  bool branch_set = false, all_branches = false;
+  bool verify = false;
+  int opt;
+
+  enum { OPT_COUNT = 256, OPT_FIRST, OPT_GENERATE, OPT_SEED, OPT_GRADE, OPT_SIZE,
+         OPT_STATS, OPT_SERVE, OPT_MAX_CHOICES, OPT_TIMEOUT, OPT_RETRY,
+         OPT_BRANCH, OPT_VERIFY };
+  static const struct option long_options[] = {
+    { "count",    optional_argument, NULL, OPT_COUNT },
+    { "first",    no_argument,       NULL, OPT_FIRST },
+    { "generate", required_argument, NULL, OPT_GENERATE },
+    { "seed",     required_argument, NULL, OPT_SEED },
+    { "grade",    no_argument,       NULL, OPT_GRADE },
+    { "size",     required_argument, NULL, OPT_SIZE },
+    { "stats",    required_argument, NULL, OPT_STATS },
+    { "serve",    required_argument, NULL, OPT_SERVE },
+    { "max-choices", required_argument, NULL, OPT_MAX_CHOICES },
+    { "timeout",  required_argument, NULL, OPT_TIMEOUT },
+    { "retry",    no_argument,       NULL, OPT_RETRY },
+    { "branch",   required_argument, NULL, OPT_BRANCH },
+    { "verify",   no_argument,       NULL, OPT_VERIFY },
+    { NULL, 0, NULL, 0 }
+  };
+
+  while ((opt = getopt_long(argc, argv, "j:p:l:e:c:bBC:", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'j':
+      workers = atoi(optarg);
+      if (workers < 1)
+        usage(argv[0]);
+      break;
+    case 'p':
+      threads = atoi(optarg);
+      if (threads < 1)
+        usage(argv[0]);
+      break;
+    case 'l':
+      o.level = atoi(optarg);
+      level_set = true;
+      if (o.level > LOCKED_CANDIDATES)
+        usage(argv[0]);
+      break;
+    case 'e':
+      o.engine = NULL;
+      for (size_t i = 0; i < NUM_ENGINES; i++)
+        if (strcmp(optarg, engines[i].name) == 0) {
+          o.engine = engines[i].engine;
+          engine_name = engines[i].name;
+          engine = i;
+        }
+      if (!o.engine)
+        usage(argv[0]);
+      engine_set = true;
+      break;
+    case 'c':
+      if (atol(optarg) < 1)
+        usage(argv[0]);
+      cache_size = atol(optarg);
+      break;
+    case 'b':
+      o.format = PACKED_RESULTS;
+      break;
+    case 'B':
+      benchmark = true;
+      break;
+    case OPT_COUNT:
+      counting = true;
+      o.limit = optarg ? atol(optarg) : LONG_MAX;
+      if (o.limit < 1)
+        usage(argv[0]);
+      break;
+    case OPT_FIRST:
+      first = true;
+      break;
+    case OPT_GENERATE:
+      generate = atol(optarg);
+      if (generate < 1)
+        usage(argv[0]);
+      break;
+    case OPT_SEED:
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case OPT_GRADE:
+      grading = true;
+      break;
+    case OPT_STATS:
+      stats_path = optarg;
+      break;
+    case OPT_SERVE:
+      serve_path = optarg;
+      break;
+    case OPT_MAX_CHOICES:
+      o.max_choices = atoi(optarg);
+      if (o.max_choices < 1)
+        usage(argv[0]);
+      break;
+    case OPT_TIMEOUT:
+      timeout_ms = atol(optarg);
+      if (timeout_ms < 1 || timeout_ms > INT_MAX)
+        usage(argv[0]);
+      o.time_limit = timeout_ms * 1000000ull;
+      break;
+    case OPT_RETRY:
+      retry = true;
+      break;
+    case OPT_VERIFY:
+      verify = true;
+      break;
+    case OPT_BRANCH:
+      all_branches = strcmp(optarg, "all") == 0;
+      if (!all_branches && !parse_branch(optarg, &o))
+        usage(argv[0]);
+      branch_set = true;
+      break;
+    case OPT_SIZE:
+      side = atoi(optarg);
+      if (side != 9 && side != 16 && side != 25)
+        usage(argv[0]);
+      break;
+    case 'C':
+      baseline = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (verify) {
+    /* nothing is solved, so --verify must come alone */
+    if (optind != 2)
+      usage(argv[0]);
+    return run_verify(argv + optind, argc - optind);
+  }
+
+  if (workers > 1 && threads > 1)
+    usage(argv[0]);
+  /* the frontier of -p is expanded in the order of solve() and solve_trail() */
+  if (threads > 1 && o.engine != solve && o.engine != solve_trail)
+    usage(argv[0]);
+  bool in_lanes = strcmp(engine_name, "lockstep") == 0;
+  if (in_lanes) {
+    /* the lanes take the whole input on one thread, with the reference order */
+    if (workers > 1 || threads > 1 || cache_size || grading || generate ||
+        benchmark || stats_path || serve_path || side != 9 || branch_set)
+      usage(argv[0]);
+  }
+  if (counting) {
+    /* the parallel search, the cache and packed results keep solutions */
+    if (threads > 1 || cache_size || o.format != TEXT_RESULTS)
+      usage(argv[0]);
+    o.max_sols = first ? 1 : 0;
+  } else if (first) {
+    usage(argv[0]);
+  }
+
+  if (branch_set) {
+    /* the other engines have their own orders; all is for -B */
+    if ((o.engine != solve && o.engine != solve_trail) || grading || side != 9 ||
+        serve_path || (all_branches && !benchmark))
+      usage(argv[0]);
+  }
+
+  bool budget = o.max_choices || o.time_limit;
+  if (budget) {
+    /*
+     * The budget is per puzzle: not per subtree of -p, nor for the
+     * grader's, the generator's and the benchmark's searches, and
+     * packed results have no room for the status.
+     */
+    if (threads > 1 || grading || generate || benchmark || side != 9 ||
+        o.format != TEXT_RESULTS)
+      usage(argv[0]);
+  } else if (retry) {
+    usage(argv[0]);
+  }
+
+  if (serve_path) {
+    /* the server takes its puzzles from the socket, one solution each */
+    sudoku_config c = { engine, o.level, o.limit, o.max_choices, timeout_ms };
+    if (optind < argc || threads > 1 || counting || first || cache_size ||
+        o.format != TEXT_RESULTS || grading || generate || benchmark ||
+        stats_path || side != 9 || retry)
+      usage(argv[0]);
+    return run_server(serve_path, &c, workers);
+  }
+
+  if (stats_path) {
+    /*
+     * The probes go around the sequential solve only, and only the
+     * reference and trail engines have them.
+     */
+    if ((o.engine != solve && o.engine != solve_trail) ||
+        workers > 1 || threads > 1 || generate || benchmark || side != 9)
+      usage(argv[0]);
+    if (!stats_open(stats_path))
+      return 1;
+  }
+
+  if (side != 9) {
+    /* board.c has the reference search only */
+    if (workers > 1 || threads > 1 || engine_set || cache_size || grading ||
+        generate || benchmark || o.format != TEXT_RESULTS || optind < argc - 1)
+      usage(argv[0]);
+    reader *r = new_reader(optind < argc ? argv[optind] : NULL);
+    if (!r) {
+      perror(optind < argc ? argv[optind] : "stdin");
+      return 1;
+    }
+    int status = run_boards(r, &o, side);
+    free_reader(r);
+    return status;
+  }
+
+  if (grading) {
+    if (threads > 1 || counting || generate || cache_size || o.format != TEXT_RESULTS)
+      usage(argv[0]);
+    o.engine = grade;
+    o.format = GRADES;
+    engine_name = "grade";
+  }
+
+  if (generate) {
+    if (optind != argc || threads > 1 || counting || first || benchmark ||
+        cache_size || o.format != TEXT_RESULTS)
+      usage(argv[0]);
+    if (!level_set)
+      o.level = HIDDEN_SINGLES;
+    run_generator(generate, seed, &o, workers);
+    return 0;
+  }
+
+  if (benchmark) {
+    if (optind == argc || workers > 1 || threads > 1 || o.format != TEXT_RESULTS || cache_size)
+      usage(argv[0]);
+    return run_bench(argv + optind, argc - optind, &o, engine_name, baseline,
+                     all_branches);
+  }
+
+  if (optind < argc - 1)
+    usage(argv[0]);
+  reader* r = new_reader(optind < argc ? argv[optind] : NULL);
+  if (!r) {
+    perror(optind < argc ? argv[optind] : "stdin");
+    return 1;
+  }
+  if (cache_size)
+    o.cache = new_cache(cache_size);
+  if (o.format == PACKED_RESULTS)
+    fwrite(packed_result_magic, 1, PACKED_MAGIC_SIZE, stdout);
+  if (retry)
+    o.retry = new_retry();
+
+  if (in_lanes) {
+    solve_lockstep(r, &o);
+  } else if (workers > 1) {
+    solve_parallel(r, &o, workers);
+  } else if (threads > 1) {
+    solver *v = new_solver(&o);
+    search *s = new_search(threads, &o);
+    writer *w = new_writer(stdout, WRITER_SIZE, o.format);
+    while (read_sudoku(r, v)) {
+      canon k;
+      if (!cache_lookup(o.cache, v, &k)) {
+        solve_split(s, v);
+        cache_store(o.cache, v, &k);
+      }
+      print_solutions(w, r->line, r->line_len, v);
+    }
+    free_writer(w);
+    free_search(s);
+    free_solver(v);
+  } else {
+    solver *v = new_solver(&o);
+    writer *w = new_writer(stdout, WRITER_SIZE, o.format);
+    for (long i = 0; read_sudoku(r, v); i++) {
+      probe p;
+      probe_start(&p);
+      solve_cached(v);
+      probe_stop(&p, v, i);
+      defer_aborted(o.retry, v, i, r->line, r->line_len);
+      print_solutions(w, r->line, r->line_len, v);
+    }
+    free_writer(w);
+    free_solver(v);
+  }
+  if (o.retry)
+    run_retries(o.retry, &o);
+  free_retry(o.retry);
   free_reader(r);
+  free_cache(o.cache);
+  stats_close();
   return 0;
 }
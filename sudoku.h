@@ -0,0 +1,72 @@
+#include <stddef.h>
+
+/*
+ * libsudoku
+ * =========
+ *
+ * The solver as a library, built both as libsudoku.a and as
+ * libsudoku.so.  A solver lives in memory provided by the caller,
+ * solver_size() bytes of it aligned as malloc() aligns, and solving
+ * allocates nothing: a program can set up a solver per thread once
+ * and then solve any number of puzzles without touching the heap.
+ * The library keeps no state of its own, so separate solvers may be
+ * used from separate threads.
+ *
+ *   sudoku_config c = { SUDOKU_REFERENCE, 1, 2 };
+ *   size_t size = solver_size(&c);
+ *   sudoku_solver *v = solver_init(malloc(size), size, &c);
+ *   solve_batch(v, puzzles, n, results);
+ *   free(v);
+ *
+ * A puzzle is SUDOKU_CELLS characters, '1'-'9' for givens and
+ * anything else (by convention '.') for open cells.  A batch of n
+ * puzzles is n * SUDOKU_CELLS characters, the puzzles back to back
+ * without line ends.
+ */
+
+#define SUDOKU_CELLS 81
+
+#define SUDOKU_API __attribute__((visibility("default")))
+
+typedef struct solver sudoku_solver;
+
+typedef enum {
+  SUDOKU_REFERENCE,
+  SUDOKU_TRAIL,
+  SUDOKU_BITBOARD,
+  SUDOKU_DLX
+} sudoku_engine;
+
+typedef struct {
+  sudoku_engine engine;
+  int level;         /* propagation: 0 naked singles, 1 hidden singles,
+                        2 locked candidates */
+  int max_solutions; /* stop at this many; 2 tells unique puzzles */
+  int max_choices;   /* give up a puzzle after this many, 0 for no limit */
+  int timeout_ms;    /* or after this long, 0 for no limit */
+} sudoku_config;
+
+typedef struct {
+  int solutions;     /* found, at most max_solutions */
+  int choices;
+  int backtracks;
+  int aborted;       /* gave up over the budget: solutions is a lower bound */
+  char solution[SUDOKU_CELLS]; /* the first one found, all '.' if none */
+} sudoku_result;
+
+/* The bytes a solver for c needs, or 0 if c is not valid. */
+SUDOKU_API size_t solver_size(sudoku_config const *c);
+
+/*
+ * Set up a solver for c in the size bytes at buf.  Returns NULL if c
+ * is not valid or buf is too small or misaligned.  The solver needs
+ * no cleanup: it is done with when buf is.
+ */
+SUDOKU_API sudoku_solver *solver_init(void *buf, size_t size, sudoku_config const *c);
+
+/*
+ * Solve the n puzzles at puzzles into results[0 .. n-1].  Returns
+ * the number of puzzles with at least one solution.
+ */
+SUDOKU_API size_t solve_batch(sudoku_solver *v, char const *puzzles, size_t n,
+                              sudoku_result *results);
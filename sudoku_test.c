@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sudoku.h"
+
+/* Tests libsudoku through sudoku.h alone, linked as libsudoku.a. */
+
+static char const unique[] =
+  "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......";
+static char const unique_solution[] =
+  "417369825632158947958724316825437169791586432346912758289643571573291684164875293";
+/* Has two solutions. */
+static char const twice[] =
+  ".43.862....9.5....8...2...319.....6..32..5.98...91.4...21.64..79.72..6.4.....7..1";
+/* Two 5s in the first row. */
+static char const broken[] =
+  "55...............................................................................";
+static char const empty[] =
+  ".................................................................................";
+
+static sudoku_engine const engines[] = {
+  SUDOKU_REFERENCE, SUDOKU_TRAIL, SUDOKU_BITBOARD, SUDOKU_DLX
+};
+#define ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+/* Whether solution is a full grid that keeps the givens of puzzle. */
+static bool solves(char const *puzzle, char const *solution)
+{
+  for (int i = 0; i < SUDOKU_CELLS; i++) {
+    if (solution[i] < '1' || solution[i] > '9')
+      return false;
+    if (puzzle[i] >= '1' && puzzle[i] <= '9' && puzzle[i] != solution[i])
+      return false;
+    for (int j = 0; j < i; j++) {
+      bool row = i / 9 == j / 9, col = i % 9 == j % 9;
+      bool box = i / 27 == j / 27 && i % 9 / 3 == j % 9 / 3;
+      if ((row || col || box) && solution[i] == solution[j])
+        return false;
+    }
+  }
+  return true;
+}
+
+static void *aligned_buffer(size_t size)
+{
+  void *buf = malloc(size + 1);
+  assert(buf && (uintptr_t)buf % (2 * sizeof(size_t)) == 0);
+  return buf;
+}
+
+void test_bad_configs(void)
+{
+  sudoku_config const bad[] = {
+    { SUDOKU_DLX + 1, 1, 2 },
+    { -1, 1, 2 },
+    { SUDOKU_REFERENCE, -1, 2 },
+    { SUDOKU_REFERENCE, 3, 2 },
+    { SUDOKU_REFERENCE, 1, 0 },
+    { SUDOKU_REFERENCE, 1, 2, -1 },
+    { SUDOKU_REFERENCE, 1, 2, 0, -1 },
+  };
+  char buf[1 << 16] __attribute__((aligned(16)));
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    assert(solver_size(&bad[i]) == 0);
+    assert(solver_init(buf, sizeof(buf), &bad[i]) == NULL);
+  }
+}
+
+void test_bad_buffers(void)
+{
+  for (size_t e = 0; e < ENGINES; e++) {
+    sudoku_config c = { engines[e], 1, 2 };
+    size_t size = solver_size(&c);
+    assert(size > 0);
+    char *buf = aligned_buffer(size);
+    assert(solver_init(NULL, size, &c) == NULL);
+    assert(solver_init(buf, size - 1, &c) == NULL);
+    assert(solver_init(buf + 1, size, &c) == NULL);
+    assert(solver_init(buf, size, &c) == (sudoku_solver *)buf);
+    free(buf);
+  }
+}
+
+void test_solve(void)
+{
+  char puzzles[4 * SUDOKU_CELLS];
+  memcpy(puzzles, unique, SUDOKU_CELLS);
+  memcpy(puzzles + SUDOKU_CELLS, twice, SUDOKU_CELLS);
+  memcpy(puzzles + 2 * SUDOKU_CELLS, broken, SUDOKU_CELLS);
+  memcpy(puzzles + 3 * SUDOKU_CELLS, unique, SUDOKU_CELLS);
+
+  for (size_t e = 0; e < ENGINES; e++) {
+    for (int level = 0; level <= 2; level++) {
+      sudoku_config c = { engines[e], level, 2 };
+      size_t size = solver_size(&c);
+      sudoku_solver *v = solver_init(aligned_buffer(size), size, &c);
+      assert(v);
+      sudoku_result r[4];
+      assert(solve_batch(v, puzzles, 4, r) == 3);
+
+      assert(r[0].solutions == 1 && !r[0].aborted);
+      assert(memcmp(r[0].solution, unique_solution, SUDOKU_CELLS) == 0);
+      assert(r[1].solutions == 2 && !r[1].aborted);
+      assert(solves(twice, r[1].solution));
+      assert(r[2].solutions == 0 && !r[2].aborted);
+      for (int i = 0; i < SUDOKU_CELLS; i++)
+        assert(r[2].solution[i] == '.');
+      /* Nothing carries over from one puzzle to the next. */
+      assert(r[3].solutions == 1 && r[3].choices == r[0].choices);
+      assert(memcmp(r[3].solution, unique_solution, SUDOKU_CELLS) == 0);
+      free(v);
+    }
+  }
+}
+
+void test_budget(void)
+{
+  for (size_t e = 0; e < ENGINES; e++) {
+    sudoku_config c = { engines[e], 1, 1000000, 10 };
+    size_t size = solver_size(&c);
+    sudoku_solver *v = solver_init(aligned_buffer(size), size, &c);
+    sudoku_result r;
+    solve_batch(v, empty, 1, &r);
+    assert(r.aborted);
+    assert(r.choices <= 10 && r.solutions < 1000000);
+    free(v);
+  }
+}
+
+int main(void)
+{
+  test_bad_configs();
+  test_bad_buffers();
+  test_solve();
+  test_budget();
+  return 0;
+}
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "verify.h"
+
+/*
+ * Verifier
+ * ========
+ *
+ * A solution is valid if every row, column and box holds each digit
+ * once, and consistent with its puzzle if it keeps every given.
+ *
+ * Each cell's digit becomes a one hot 16 bit mask (bit d-1 for digit
+ * d, nothing for anything else), and a unit holds every digit exactly
+ * when the masks of its 9 cells OR to 0x1FF: nine cells can only
+ * cover nine bits if no two share one.  The ORs are taken for all
+ * units at once by ORing whole vectors of masks at offsets:
+ *
+ *   three[k] = m[k] | m[k+1] | m[k+2]          three cells of a row
+ *   row[k]   = three[k] | three[k+3] | three[k+6]
+ *   box[k]   = three[k] | three[k+9] | three[k+18]
+ *   col[k]   = m[k] | m[k+9] | ... | m[k+72]
+ *
+ * row[k] is the OR of row k/9 where k is a multiple of 9, box[k] that
+ * of the box whose top left cell is k, and col[k] that of column k
+ * for k < 9; the other lanes are ignored.  So a solution is checked
+ * with a few dozen vector operations and no loop over cells.
+ *
+ * Loading a vector from memory just written at a different offset
+ * stalls until the stores are done, which costs more than the vector
+ * operations themselves.  So a whole batch goes through each step
+ * before the next step starts: by the time any array is read at an
+ * offset, it was written long enough ago.
+ */
+
+#define FULL_UNIT 0x1FF
+#define SCRATCH   128  /* cells in the scratch arrays: 81, padded */
+
+typedef struct {
+  uint16_t m[VERIFY_BATCH][SCRATCH];      /* one hot masks */
+  uint16_t three[VERIFY_BATCH][SCRATCH];
+} scratch;
+
+#if defined(__SSSE3__)
+
+#include <immintrin.h>
+
+#if defined(__AVX2__)
+
+#define LANES 16
+typedef __m256i lanes;
+#define LOAD(p)         _mm256_loadu_si256((__m256i const *)(p))
+#define SET1(x)         _mm256_set1_epi16(x)
+#define ZERO()          _mm256_setzero_si256()
+#define OR(a, b)        _mm256_or_si256(a, b)
+#define ANDNOT(a, b)    _mm256_andnot_si256(a, b)
+#define EQ16(a, b)      _mm256_cmpeq_epi16(a, b)
+#define ALL_ZERO(a)     _mm256_testz_si256(a, a)
+#define STORE(p, a)     _mm256_storeu_si256((__m256i *)(p), a)
+
+#else
+
+#define LANES 8
+typedef __m128i lanes;
+#define LOAD(p)         _mm_loadu_si128((__m128i const *)(p))
+#define SET1(x)         _mm_set1_epi16(x)
+#define ZERO()          _mm_setzero_si128()
+#define OR(a, b)        _mm_or_si128(a, b)
+#define ANDNOT(a, b)    _mm_andnot_si128(a, b)
+#define EQ16(a, b)      _mm_cmpeq_epi16(a, b)
+#define ALL_ZERO(a)     (_mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm_setzero_si128())) == 0xFFFF)
+#define STORE(p, a)     _mm_storeu_si128((__m128i *)(p), a)
+
+#endif
+
+#define VECTORS(cells)  (((cells) + LANES - 1) / LANES)
+
+/* The lanes whose units are checked, all ones where they are. */
+static const uint16_t row_lanes[80] = {
+  [0] = 0xFFFF, [9] = 0xFFFF, [18] = 0xFFFF, [27] = 0xFFFF, [36] = 0xFFFF,
+  [45] = 0xFFFF, [54] = 0xFFFF, [63] = 0xFFFF, [72] = 0xFFFF
+};
+static const uint16_t box_lanes[64] = {
+  [0] = 0xFFFF, [3] = 0xFFFF, [6] = 0xFFFF, [27] = 0xFFFF, [30] = 0xFFFF,
+  [33] = 0xFFFF, [54] = 0xFFFF, [57] = 0xFFFF, [60] = 0xFFFF
+};
+static const uint16_t col_lanes[16] = {
+  0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF
+};
+
+/*
+ * Write the one hot masks of the 96 characters at text to m, 16 at
+ * a time: the low and the high byte of each mask come from a byte
+ * shuffle each, and are interleaved into 16 bit lanes.
+ */
+static inline void digit_masks(uint16_t *m, char const *text)
+{
+  __m128i one = _mm_set1_epi8('1'), eight = _mm_set1_epi8(8);
+  __m128i low = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  __m128i high = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0);
+  for (int i = 0; i < 96; i += 16) {
+    __m128i d = _mm_sub_epi8(_mm_loadu_si128((__m128i const *)(text + i)), one);
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(d, eight), d);
+    __m128i lo = _mm_and_si128(_mm_shuffle_epi8(low, d), digit);
+    __m128i hi = _mm_and_si128(_mm_shuffle_epi8(high, d), digit);
+    _mm_storeu_si128((__m128i *)(m + i), _mm_unpacklo_epi8(lo, hi));
+    _mm_storeu_si128((__m128i *)(m + i + 8), _mm_unpackhi_epi8(lo, hi));
+  }
+}
+
+static void three_cells(uint16_t *three, uint16_t const *m)
+{
+  for (int i = 0; i < VECTORS(96); i++) {
+    int k = i * LANES;
+    STORE(three + k, OR(OR(LOAD(m + k), LOAD(m + k + 1)), LOAD(m + k + 2)));
+  }
+}
+
+static bool valid_grid(uint16_t const *m, uint16_t const *three)
+{
+  lanes full = SET1(FULL_UNIT), bad = ZERO();
+  for (int i = 0; i < VECTORS(80); i++) {
+    int k = i * LANES;
+    lanes row = OR(OR(LOAD(three + k), LOAD(three + k + 3)), LOAD(three + k + 6));
+    bad = OR(bad, ANDNOT(EQ16(row, full), LOAD(row_lanes + k)));
+  }
+  for (int i = 0; i < VECTORS(64); i++) {
+    int k = i * LANES;
+    lanes box = OR(OR(LOAD(three + k), LOAD(three + k + 9)), LOAD(three + k + 18));
+    bad = OR(bad, ANDNOT(EQ16(box, full), LOAD(box_lanes + k)));
+  }
+  for (int i = 0; i < VECTORS(16); i++) {
+    int k = i * LANES;
+    lanes col = LOAD(m + k);
+    for (int r = 1; r < 9; r++)
+      col = OR(col, LOAD(m + k + 9 * r));
+    bad = OR(bad, ANDNOT(EQ16(col, full), LOAD(col_lanes + k)));
+  }
+  return ALL_ZERO(bad);
+}
+
+/* Whether solution keeps every given of puzzle, 16 cells at a time. */
+static bool keeps_givens(char const *puzzle, char const *solution)
+{
+  __m128i one = _mm_set1_epi8('1'), eight = _mm_set1_epi8(8);
+  __m128i bad = _mm_setzero_si128();
+  for (int i = 0; i < 96; i += 16) {
+    __m128i p = _mm_loadu_si128((__m128i const *)(puzzle + i));
+    __m128i s = _mm_loadu_si128((__m128i const *)(solution + i));
+    __m128i d = _mm_sub_epi8(p, one);
+    __m128i given = _mm_cmpeq_epi8(_mm_min_epu8(d, eight), d);
+    bad = _mm_or_si128(bad, _mm_andnot_si128(_mm_cmpeq_epi8(p, s), given));
+  }
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) == 0xFFFF;
+}
+
+static void check_batch(verify_batch const *b, verify_status *status)
+{
+  scratch t;
+  for (int i = 0; i < b->count; i++) {
+    digit_masks(t.m[i], b->solution[i]);
+    STORE(t.m[i] + 96, ZERO()); /* read by the last lanes of three */
+  }
+  for (int i = 0; i < b->count; i++)
+    three_cells(t.three[i], t.m[i]);
+  for (int i = 0; i < b->count; i++)
+    status[i] = !valid_grid(t.m[i], t.three[i]) ? VERIFY_INVALID
+      : !keeps_givens(b->puzzle[i], b->solution[i]) ? VERIFY_MISMATCH
+      : VERIFY_OK;
+}
+
+#else
+
+static bool valid_grid(char const *text)
+{
+  uint16_t unit[27] = { 0 };
+  for (int p = 0; p < VERIFY_CELLS; p++) {
+    if (text[p] < '1' || text[p] > '9')
+      return false;
+    uint16_t m = 1 << (text[p] - '1');
+    unit[p / 9] |= m;
+    unit[9 + p % 9] |= m;
+    unit[18 + p / 27 * 3 + p % 9 / 3] |= m;
+  }
+  for (int u = 0; u < 27; u++)
+    if (unit[u] != FULL_UNIT)
+      return false;
+  return true;
+}
+
+static bool keeps_givens(char const *puzzle, char const *solution)
+{
+  for (int p = 0; p < VERIFY_CELLS; p++)
+    if ('1' <= puzzle[p] && puzzle[p] <= '9' && puzzle[p] != solution[p])
+      return false;
+  return true;
+}
+
+static void check_batch(verify_batch const *b, verify_status *status)
+{
+  for (int i = 0; i < b->count; i++)
+    status[i] = !valid_grid(b->solution[i]) ? VERIFY_INVALID
+      : !keeps_givens(b->puzzle[i], b->solution[i]) ? VERIFY_MISMATCH
+      : VERIFY_OK;
+}
+
+#endif
+
+bool verify_add(verify_batch *b, char const *puzzle, char const *solution)
+{
+  /* the padding stays as zeroed */
+  memcpy(b->puzzle[b->count], puzzle, VERIFY_CELLS);
+  memcpy(b->solution[b->count], solution, VERIFY_CELLS);
+  return ++b->count == VERIFY_BATCH;
+}
+
+int verify_run(verify_batch *b, verify_status *status)
+{
+  int n = b->count;
+  check_batch(b, status);
+  b->count = 0;
+  return n;
+}
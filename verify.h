@@ -0,0 +1,37 @@
+#include <stdbool.h>
+
+/*
+ * Checking solutions, see verify.c.  Puzzles and solutions are text
+ * of VERIFY_CELLS characters, solutions '1'-'9' throughout.  They are
+ * checked in batches:
+ *
+ *   verify_batch b = { 0 };
+ *   verify_status status[VERIFY_BATCH];
+ *   while (...)
+ *     if (verify_add(&b, puzzle, solution))
+ *       verify_run(&b, status);  // status[i] for the i-th one added
+ *   ...
+ *   n = verify_run(&b, status);  // the rest, n of them
+ */
+
+#define VERIFY_CELLS  81
+#define VERIFY_PADDED 96  /* whole vectors, zeros after the text */
+#define VERIFY_BATCH  16
+
+typedef enum {
+  VERIFY_OK,
+  VERIFY_INVALID,   /* some row, column or box lacks a digit */
+  VERIFY_MISMATCH   /* the solution differs from a given of the puzzle */
+} verify_status;
+
+typedef struct {
+  int  count;
+  char puzzle[VERIFY_BATCH][VERIFY_PADDED];
+  char solution[VERIFY_BATCH][VERIFY_PADDED];
+} verify_batch;
+
+/* Add a solution to b.  Returns true when b is full. */
+bool verify_add(verify_batch *b, char const *puzzle, char const *solution);
+
+/* Check the solutions in b into status and empty b.  Returns how many. */
+int verify_run(verify_batch *b, verify_status *status);
@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <string.h>
+
+#include "verify.h"
+
+/*
+ * Built twice, against the vector verifier and against the scalar
+ * one (verify_scalar.o), so that both are held to the same answers.
+ */
+
+static char const puzzle[] =
+  "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......";
+static char const solution[] =
+  "417369825632158947958724316825437169791586432346912758289643571573291684164875293";
+
+/* The status of solution s for puzzle p, one cell at a time. */
+static verify_status expected(char const *p, char const *s)
+{
+  int unit[27] = { 0 };
+  for (int i = 0; i < VERIFY_CELLS; i++) {
+    if (s[i] < '1' || s[i] > '9')
+      return VERIFY_INVALID;
+    int m = 1 << (s[i] - '1');
+    unit[i / 9] |= m;
+    unit[9 + i % 9] |= m;
+    unit[18 + i / 27 * 3 + i % 9 / 3] |= m;
+  }
+  for (int u = 0; u < 27; u++)
+    if (unit[u] != 0x1FF)
+      return VERIFY_INVALID;
+  for (int i = 0; i < VERIFY_CELLS; i++)
+    if (p[i] >= '1' && p[i] <= '9' && p[i] != s[i])
+      return VERIFY_MISMATCH;
+  return VERIFY_OK;
+}
+
+static verify_status check_one(char const *p, char const *s)
+{
+  static verify_batch b;
+  verify_status status[VERIFY_BATCH];
+  assert(!verify_add(&b, p, s));
+  assert(verify_run(&b, status) == 1);
+  return status[0];
+}
+
+static void swap(char *s, int a, int b)
+{
+  char c = s[a];
+  s[a] = s[b];
+  s[b] = c;
+}
+
+void test_cases(void)
+{
+  char s[VERIFY_CELLS];
+
+  assert(check_one(puzzle, solution) == VERIFY_OK);
+  assert(check_one(solution, solution) == VERIFY_OK);
+
+  /* two digits swapped in a row leave the columns short */
+  memcpy(s, solution, VERIFY_CELLS);
+  swap(s, 1, 2);
+  assert(check_one(s, s) == VERIFY_INVALID);
+
+  /* and two in a column, the rows */
+  memcpy(s, solution, VERIFY_CELLS);
+  swap(s, 9 * 4 + 7, 9 * 8 + 7);
+  assert(check_one(s, s) == VERIFY_INVALID);
+
+  /* swapping two rows of a band keeps every unit whole */
+  memcpy(s, solution, VERIFY_CELLS);
+  for (int c = 0; c < 9; c++)
+    swap(s, 9 * 6 + c, 9 * 8 + c);
+  assert(check_one(s, s) == VERIFY_OK);
+  assert(check_one(puzzle, s) == VERIFY_MISMATCH);
+
+  /* a valid grid that changes a given */
+  char p[VERIFY_CELLS];
+  memcpy(p, puzzle, VERIFY_CELLS);
+  p[1] = solution[1] == '9' ? '1' : solution[1] + 1;
+  assert(check_one(p, solution) == VERIFY_MISMATCH);
+
+  /* what isn't a digit covers nothing */
+  char const bad[] = { '0', '.', ' ', ':', '\0', (char)0x80 + '1' };
+  for (size_t i = 0; i < sizeof(bad); i++)
+    for (int cell = 0; cell < VERIFY_CELLS; cell += 40) {
+      memcpy(s, solution, VERIFY_CELLS);
+      s[cell] = bad[i];
+      assert(check_one(puzzle, s) == VERIFY_INVALID);
+    }
+}
+
+/*
+ * Every cell changed to every other digit, 16 to a batch and the
+ * rest in a partial one, against expected().
+ */
+void test_every_cell(void)
+{
+  static verify_batch b;
+  static char s[VERIFY_CELLS * 9][VERIFY_CELLS];
+  verify_status status[VERIFY_BATCH];
+  int n = 0, checked = 0;
+  for (int cell = 0; cell < VERIFY_CELLS; cell++)
+    for (char d = '1'; d <= '9'; d++) {
+      memcpy(s[n], solution, VERIFY_CELLS);
+      s[n][cell] = d;
+      n++;
+    }
+  for (int i = 0; i < n; i++) {
+    if (verify_add(&b, puzzle, s[i])) {
+      assert(verify_run(&b, status) == VERIFY_BATCH);
+      for (int j = 0; j < VERIFY_BATCH; j++, checked++)
+        assert(status[j] == expected(puzzle, s[checked]));
+    }
+  }
+  int rest = verify_run(&b, status);
+  assert(rest == n % VERIFY_BATCH && rest > 0);
+  for (int j = 0; j < rest; j++, checked++)
+    assert(status[j] == expected(puzzle, s[checked]));
+  assert(checked == n);
+  assert(verify_run(&b, status) == 0);
+}
+
+/* Random swaps, which keep the digit counts and so test the units. */
+void test_swaps(void)
+{
+  srand(1);
+  for (int round = 0; round < 10000; round++) {
+    char s[VERIFY_CELLS];
+    memcpy(s, solution, VERIFY_CELLS);
+    for (int k = rand() % 3; k >= 0; k--)
+      swap(s, rand() % VERIFY_CELLS, rand() % VERIFY_CELLS);
+    assert(check_one(puzzle, s) == expected(puzzle, s));
+  }
+}
+
+int main(void)
+{
+  test_cases();
+  test_every_cell();
+  test_swaps();
+  return 0;
+}